@@ -0,0 +1,147 @@
+/* arena.c: allocating a decoder's memory all together. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "teseq.h"
+
+#include <stdlib.h>
+
+#include "arena.h"
+
+/* Everything handed out is aligned as for the most demanding of
+   these. */
+union align
+{
+  long l;
+  double d;
+  void *p;
+};
+
+#define ALIGN(n) \
+  (((n) + sizeof (union align) - 1) / sizeof (union align) \
+   * sizeof (union align))
+
+/* A block of memory, followed by the memory itself. */
+struct block
+{
+  struct block *next;
+  size_t size;
+  size_t used;
+  union align mem[1];
+};
+
+struct arena
+{
+  struct block *blocks;         /* The newest first; the first block
+                                   made is last. */
+};
+
+static struct block *
+block_new (size_t size)
+{
+  struct block *b = malloc (offsetof (struct block, mem) + size);
+
+  if (!b)
+    return NULL;
+  b->next = NULL;
+  b->size = size;
+  b->used = 0;
+  return b;
+}
+
+/* Make an arena whose first block holds SIZE bytes. */
+struct arena *
+arena_new (size_t size)
+{
+  struct arena *a = malloc (sizeof *a);
+
+  if (!a)
+    return NULL;
+  a->blocks = block_new (ALIGN (size));
+  if (!a->blocks)
+    {
+      free (a);
+      return NULL;
+    }
+  return a;
+}
+
+/* Free every block but the first. */
+static void
+free_extra_blocks (struct arena *a)
+{
+  while (a->blocks->next)
+    {
+      struct block *b = a->blocks;
+      a->blocks = b->next;
+      free (b);
+    }
+}
+
+void
+arena_delete (struct arena *a)
+{
+  free_extra_blocks (a);
+  free (a->blocks);
+  free (a);
+}
+
+/* Forget everything allocated from A, keeping its first block for
+   reuse. */
+void
+arena_reset (struct arena *a)
+{
+  free_extra_blocks (a);
+  a->blocks->used = 0;
+}
+
+/* Allocate SIZE bytes from A, or with malloc if A is NULL. Returns
+   NULL if out of memory. */
+void *
+arena_alloc (struct arena *a, size_t size)
+{
+  struct block *b;
+  void *mem;
+
+  if (!a)
+    return malloc (size);
+  size = ALIGN (size);
+  b = a->blocks;
+  if (b->size - b->used < size)
+    {
+      b = block_new (size > b->size ? size : b->size);
+      if (!b)
+        return NULL;
+      b->next = a->blocks;
+      a->blocks = b;
+    }
+  mem = (char *) b->mem + b->used;
+  b->used += size;
+  return mem;
+}
+
+/* Free MEM, if it came from malloc (that is, if A is NULL). Memory
+   from an arena is freed with the arena. */
+void
+arena_free (struct arena *a, void *mem)
+{
+  if (!a)
+    free (mem);
+}
@@ -0,0 +1,53 @@
+/* arena.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Arenas.
+
+    An arena hands out memory from one block, which is allocated when
+    the arena is made (further blocks are chained on if it runs out),
+    and is all freed at once when the arena is deleted or reset. A
+    decoder's state is kept in an arena of its own, so that it sits
+    together in memory, and so that it can be made, thrown away or
+    reused without a call to malloc or free for each part.
+
+    The constructors that take an arena (the *_new_in functions) fall
+    back to malloc when it is NULL. Their delete functions free only
+    what didn't come from an arena: arena_free does the right thing
+    either way.
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "teseq.h"
+
+#include <stddef.h>
+
+struct arena;
+
+struct arena *arena_new (size_t size);
+void arena_delete (struct arena *);
+void arena_reset (struct arena *);
+void *arena_alloc (struct arena *, size_t);
+void arena_free (struct arena *, void *);
+
+#endif
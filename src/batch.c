@@ -0,0 +1,454 @@
+/* batch.c: decoding many files in one run, for --batch. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* For getline. */
+#define _GNU_SOURCE
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+
+extern const char *program_name;
+
+#ifdef HAVE_BATCH
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* How much of a file is read at a time. */
+#define READ_SIZE       65536
+
+/* What's added to an input's name for its timings, and its output. */
+#define TIMING_SUFFIX   ".timing"
+#define OUTPUT_SUFFIX   ".teseq"
+
+struct worker
+{
+  pthread_t tid;
+  pthread_mutex_t lock;
+  size_t next;                  /* The files still to do: those from */
+  size_t end;                   /* next up to (not including) end. */
+  struct processor *proc;       /* Kept from one file to the next. */
+  unsigned char *buf;
+  int failed;
+};
+
+static const struct config *config;
+static char **files;
+static struct worker *workers;
+static long n_workers;
+
+/* Take the next of W's own files, into *I. Returns zero if it has
+   none left. */
+static int
+take (struct worker *w, size_t *i)
+{
+  int found;
+
+  pthread_mutex_lock (&w->lock);
+  found = w->next != w->end;
+  if (found)
+    *i = w->next++;
+  pthread_mutex_unlock (&w->lock);
+  return found;
+}
+
+/* Give W (which has none of its own left) the later half of the files
+   another worker has left. Returns zero if none has any. */
+static int
+steal (struct worker *w)
+{
+  long self = w - workers;
+  long k;
+
+  for (k = 1; k != n_workers; ++k)
+    {
+      struct worker *v = &workers[(self + k) % n_workers];
+      size_t from = 0, to = 0;
+
+      pthread_mutex_lock (&v->lock);
+      if (v->next != v->end)
+        {
+          to = v->end;
+          from = to - (to - v->next + 1) / 2;
+          v->end = from;
+        }
+      pthread_mutex_unlock (&v->lock);
+      if (from != to)
+        {
+          pthread_mutex_lock (&w->lock);
+          w->next = from;
+          w->end = to;
+          pthread_mutex_unlock (&w->lock);
+          return 1;
+        }
+    }
+  return 0;
+}
+
+static int
+has_suffix (const char *s, const char *suffix)
+{
+  size_t len = strlen (s), slen = strlen (suffix);
+  return len >= slen && strcmp (s + len - slen, suffix) == 0;
+}
+
+/* The last part of PATH, which names its output. */
+static const char *
+base_name (const char *path)
+{
+  const char *base = strrchr (path, '/');
+  return base ? base + 1 : path;
+}
+
+/* Return a new string of A, B and C, one after the other; or NULL if
+   out of memory. */
+static char *
+concat (const char *a, const char *b, const char *c)
+{
+  size_t alen = strlen (a), blen = strlen (b), clen = strlen (c);
+  char *s = malloc (alen + blen + clen + 1);
+
+  if (s)
+    {
+      memcpy (s, a, alen);
+      memcpy (s + alen, b, blen);
+      memcpy (s + alen + blen, c, clen + 1);
+    }
+  return s;
+}
+
+static void
+file_write_error (int e, void *arg)
+{
+  int *failed = arg;
+  if (!*failed)
+    *failed = e ? e : EIO;
+}
+
+/* Decode all of FD into P, reading it into BUF. Returns 0 on
+   success, or an errno value on a read error. */
+static int
+decode (struct processor *p, int fd, unsigned char *buf)
+{
+  for (;;)
+    {
+      ssize_t n = read (fd, buf, READ_SIZE);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1)
+        return errno;
+      if (n == 0)
+        break;
+      processor_feed (p, buf, n);
+    }
+  processor_feed (p, NULL, 0);
+  processor_finish (p);
+  return 0;
+}
+
+/* Decode the file at PATH, with W's processor, into the output
+   directory. Returns 0 on success, or -1 (having said why) on an
+   error. */
+static int
+convert (struct worker *w, const char *path)
+{
+  char *out_path = NULL, *timings_path = NULL;
+  FILE *outf = NULL, *timings = NULL;
+  int fd, failed = 0, read_err = 0;
+  const char *what = path;
+
+  out_path = concat (config->batch_dir, "/", base_name (path));
+  if (out_path)
+    {
+      char *s = concat (out_path, OUTPUT_SUFFIX, "");
+      free (out_path);
+      out_path = s;
+    }
+  timings_path = concat (path, TIMING_SUFFIX, "");
+  if (!out_path || !timings_path)
+    {
+      free (out_path);
+      free (timings_path);
+      fprintf (stderr, "%s: Out of memory.\n", program_name);
+      return -1;
+    }
+
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    failed = errno;
+  if (!failed && !(timings = fopen (timings_path, "r"))
+      && errno != ENOENT)
+    {
+      failed = errno;
+      what = timings_path;
+    }
+  if (!failed && !(outf = fopen (out_path, "w")))
+    {
+      failed = errno;
+      what = out_path;
+    }
+  if (!failed)
+    {
+      w->proc = w->proc ? processor_reuse (w->proc, outf)
+        : processor_new (config, outf);
+      if (!w->proc)
+        failed = ENOMEM;
+    }
+  if (!failed)
+    {
+      processor_set_handler (w->proc, file_write_error, &failed);
+      processor_set_timings (w->proc, timings);
+      read_err = decode (w->proc, fd, w->buf);
+      if (fclose (outf) != 0 && !failed)
+        failed = errno;
+      outf = NULL;
+      if (failed)
+        what = out_path;
+      else if (read_err)
+        failed = read_err;
+    }
+  if (failed)
+    fprintf (stderr, "%s: %s: %s\n", program_name, what,
+             strerror (failed));
+  if (outf)
+    fclose (outf);
+  if (timings)
+    fclose (timings);
+  if (fd != -1)
+    close (fd);
+  free (out_path);
+  free (timings_path);
+  return failed ? -1 : 0;
+}
+
+static void *
+worker (void *arg)
+{
+  struct worker *w = arg;
+  size_t i;
+
+  for (;;)
+    {
+      while (take (w, &i))
+        {
+          if (has_suffix (files[i], TIMING_SUFFIX))
+            continue;
+          if (convert (w, files[i]) != 0)
+            w->failed = 1;
+        }
+      if (!steal (w))
+        break;
+    }
+  return NULL;
+}
+
+static int
+compare_names (const void *a, const void *b)
+{
+  return strcmp (base_name (files[*(const size_t *) a]),
+                 base_name (files[*(const size_t *) b]));
+}
+
+/* Check that no two of the N files would be decoded to the same
+   output file. Returns 0 if so, or -1 (having said why) if not. */
+static int
+check_names (size_t n)
+{
+  size_t *order = malloc ((n ? n : 1) * sizeof *order);
+  size_t i, count = 0;
+  int ret = 0;
+
+  if (!order)
+    {
+      fprintf (stderr, "%s: Out of memory.\n", program_name);
+      return -1;
+    }
+  for (i = 0; i != n; ++i)
+    if (!has_suffix (files[i], TIMING_SUFFIX))
+      order[count++] = i;
+  qsort (order, count, sizeof *order, compare_names);
+  for (i = 1; i < count && ret == 0; ++i)
+    if (compare_names (&order[i - 1], &order[i]) == 0)
+      {
+        fprintf (stderr, "%s: %s and %s would both be decoded to "
+                 "%s/%s%s.\n", program_name, files[order[i - 1]],
+                 files[order[i]], config->batch_dir,
+                 base_name (files[order[i]]), OUTPUT_SUFFIX);
+        ret = -1;
+      }
+  free (order);
+  return ret;
+}
+
+/* Read the names of the files to decode from F, one per line, into
+   a new NULL-terminated array. Returns NULL if out of memory. */
+static char **
+read_names (FILE *f, size_t *count)
+{
+  char **names = NULL;
+  size_t n = 0, size = 0;
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t len;
+
+  while ((len = getline (&line, &line_size, f)) != -1)
+    {
+      if (len && line[len - 1] == '\n')
+        line[--len] = '\0';
+      if (len == 0)
+        continue;
+      if (n + 1 >= size)
+        {
+          char **grown;
+          size = size ? size * 2 : 64;
+          grown = realloc (names, size * sizeof *names);
+          if (!grown)
+            goto oom;
+          names = grown;
+        }
+      if (!(names[n] = strdup (line)))
+        goto oom;
+      names[++n] = NULL;
+    }
+  free (line);
+  if (!names)
+    names = calloc (1, sizeof *names);
+  *count = n;
+  return names;
+
+ oom:
+  while (n)
+    free (names[--n]);
+  free (names);
+  free (line);
+  return NULL;
+}
+
+/* Free the N names of the files, if they were read by read_names. */
+static void
+free_names (const struct config *cfg, size_t n)
+{
+  if (!cfg->batch_files)
+    {
+      while (n)
+        free (files[--n]);
+      free (files);
+    }
+}
+
+/* Decode each of the files given by CFG into its own output file.
+   Returns the program's exit status. */
+int
+batch_run (const struct config *cfg)
+{
+  long threads = cfg->threads;
+  size_t n = 0;
+  long i, started;
+  int status = EXIT_SUCCESS;
+
+  config = cfg;
+  files = cfg->batch_files;
+  if (files)
+    while (files[n])
+      ++n;
+  else if (!(files = read_names (stdin, &n)))
+    {
+      fprintf (stderr, "%s: Out of memory.\n", program_name);
+      return EXIT_FAILURE;
+    }
+  if (check_names (n) != 0)
+    {
+      free_names (cfg, n);
+      return EXIT_FAILURE;
+    }
+  if (threads <= 0)
+    threads = sysconf (_SC_NPROCESSORS_ONLN);
+  if (threads <= 0)
+    threads = 1;
+  if ((size_t) threads > n)
+    threads = n ? n : 1;
+
+  workers = calloc (threads, sizeof *workers);
+  if (!workers)
+    {
+      fprintf (stderr, "%s: Out of memory.\n", program_name);
+      return EXIT_FAILURE;
+    }
+  n_workers = threads;
+  for (i = 0; i != threads; ++i)
+    {
+      struct worker *w = &workers[i];
+      pthread_mutex_init (&w->lock, NULL);
+      /* Each starts with an equal run of the files. */
+      w->next = n * i / threads;
+      w->end = n * (i + 1) / threads;
+      w->buf = malloc (READ_SIZE);
+      if (!w->buf)
+        {
+          fprintf (stderr, "%s: Out of memory.\n", program_name);
+          return EXIT_FAILURE;
+        }
+    }
+
+  /* A worker that can't be started leaves its files to be stolen. */
+  for (started = 0; started != threads; ++started)
+    if (pthread_create (&workers[started].tid, NULL, worker,
+                        &workers[started]) != 0)
+      break;
+  if (started == 0)
+    worker (&workers[0]);
+  for (i = 0; i != started; ++i)
+    pthread_join (workers[i].tid, NULL);
+
+  for (i = 0; i != threads; ++i)
+    {
+      struct worker *w = &workers[i];
+      if (w->failed)
+        status = EXIT_FAILURE;
+      if (w->proc)
+        processor_delete (w->proc);
+      free (w->buf);
+      pthread_mutex_destroy (&w->lock);
+    }
+  free (workers);
+  free_names (cfg, n);
+  return status;
+}
+
+#else
+
+int
+batch_run (const struct config *cfg)
+{
+  fprintf (stderr, "%s: --batch isn't supported on this system.\n",
+           program_name);
+  return EXIT_FAILURE;
+}
+
+#endif /* HAVE_BATCH */
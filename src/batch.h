@@ -0,0 +1,51 @@
+/* batch.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+    Batch mode.
+
+    With --batch, teseq decodes each of many files into a file of its
+    own in an output directory, all in one run, so that the start-up
+    and configuration are paid once rather than per file. The files
+    are shared out among a pool of threads, each starting with an
+    equal run of them; a thread that finishes its run takes the later
+    half of what's left of another's, so that a few big files don't
+    hold up the rest. Each thread keeps its processor and read buffer
+    from one file to the next, starting the processor over (as for
+    --listen) rather than making a new one.
+
+    A file named like an input with ".timing" added is taken as the
+    timings for it, as with -t, and isn't decoded itself.
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "teseq.h"
+
+#if defined (HAVE_PTHREAD_H)
+#  define HAVE_BATCH    1
+#endif
+
+int batch_run (const struct config *);
+
+#endif
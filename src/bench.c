@@ -0,0 +1,484 @@
+/* bench.c: throughput benchmark for teseq. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Generates synthetic workloads representative of what teseq is fed
+    (plain text, colored output, full-screen redraws, UTF-8, long OSC
+    strings, typescripts with timings), and runs each of them through
+    teseq's own main, in-process, with the output going to /dev/null.
+    For each workload, the best of several runs is reported, as a
+    line of tab-separated values, along with the number of allocations
+    made during a run (when the linker lets us count them).
+*/
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef HAVE_LD_WRAP
+/* Linked with -Wl,--wrap=malloc (and so on), so that these see every
+   allocation made by teseq's own code. */
+static unsigned long allocations;
+
+void *__real_malloc (size_t);
+void *__real_calloc (size_t, size_t);
+void *__real_realloc (void *, size_t);
+
+void *
+__wrap_malloc (size_t n)
+{
+  ++allocations;
+  return __real_malloc (n);
+}
+
+void *
+__wrap_calloc (size_t n, size_t sz)
+{
+  ++allocations;
+  return __real_calloc (n, sz);
+}
+
+void *
+__wrap_realloc (void *p, size_t n)
+{
+  ++allocations;
+  return __real_realloc (p, n);
+}
+#endif
+
+#define DEFAULT_SIZE    (4ul * 1024 * 1024)
+#define DEFAULT_RUNS    5
+
+extern const char *program_name;
+
+struct gen
+{
+  FILE *f;
+  FILE *timings;                /* Only for workloads that have one. */
+  size_t written;
+};
+
+/* The workloads are the same from one run of the benchmark to the
+   next. */
+static unsigned long seed;
+
+static unsigned long
+rnd (unsigned long n)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % n;
+}
+
+static void
+out (struct gen *g, const char *format, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start (ap, format);
+  n = vfprintf (g->f, format, ap);
+  va_end (ap);
+  if (n > 0)
+    g->written += n;
+}
+
+static void
+words (struct gen *g, size_t len)
+{
+  static const char *const list[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+    "terminal", "escape", "sequence", "control", "function", "teseq",
+    "a", "of", "to", "in", "is", "and", "make", "error", "warning"
+  };
+  size_t n = 0;
+
+  while (n < len)
+    {
+      const char *w = list[rnd (N_ARY_ELEMS (list))];
+      out (g, "%s%s", n ? " " : "", w);
+      n += strlen (w) + (n != 0);
+    }
+}
+
+/* Lines of plain text. */
+static void
+gen_text (struct gen *g, size_t size)
+{
+  while (g->written < size)
+    {
+      words (g, 20 + rnd (60));
+      out (g, "\n");
+    }
+}
+
+/* Colored output, like that of ls --color or a compiler's
+   diagnostics. */
+static void
+gen_sgr (struct gen *g, size_t size)
+{
+  static const char *const colors[] = {
+    "01;34", "01;32", "0;31", "01;36", "33", "01;35", "38;5;208",
+    "1;38;2;255;128;0"
+  };
+
+  while (g->written < size)
+    {
+      int i, n = 1 + rnd (6);
+      for (i = 0; i != n; ++i)
+        {
+          out (g, "\033[%sm", colors[rnd (N_ARY_ELEMS (colors))]);
+          words (g, 4 + rnd (12));
+          out (g, "\033[0m  ");
+        }
+      out (g, "\r\n");
+    }
+}
+
+/* Full-screen redraws, as from a curses program. */
+static void
+gen_curses (struct gen *g, size_t size)
+{
+  while (g->written < size)
+    {
+      int row;
+      out (g, "\033[?25l\033[H\033[2J\033[1;24r");
+      for (row = 1; row <= 24; ++row)
+        {
+          out (g, "\033[%d;%dH", row, 1 + (int) rnd (10));
+          if (rnd (3) == 0)
+            out (g, "\033[7m");
+          words (g, 10 + rnd (60));
+          out (g, "\033[m\033[K");
+        }
+      out (g, "\033[24;1H\033[?25h");
+    }
+}
+
+/* Text with multibyte UTF-8 characters. */
+static void
+gen_utf8 (struct gen *g, size_t size)
+{
+  static const char *const list[] = {
+    "caf\xc3\xa9", "na\xc3\xafve", "\xe2\x86\x92", "\xe2\x94\x80\xe2\x94\x80",
+    "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e", "\xf0\x9f\x98\x80", "text"
+  };
+
+  while (g->written < size)
+    {
+      int i, n = 4 + rnd (16);
+      for (i = 0; i != n; ++i)
+        out (g, "%s ", list[rnd (N_ARY_ELEMS (list))]);
+      out (g, "\n");
+    }
+}
+
+/* Long OSC strings: window titles and hyperlinks. */
+static void
+gen_osc (struct gen *g, size_t size)
+{
+  while (g->written < size)
+    {
+      out (g, "\033]0;");
+      words (g, 200 + rnd (2000));
+      out (g, "\007\033]8;;http://www.gnu.org/software/teseq/");
+      words (g, 20 + rnd (100));
+      out (g, "\033\\");
+      words (g, 10 + rnd (30));
+      out (g, "\033]8;;\033\\\n");
+    }
+}
+
+/* A typescript, with its timings file: colored output, in chunks of
+   varying sizes. */
+static void
+gen_timings (struct gen *g, size_t size)
+{
+  out (g, "Script started on Thu 01 Jan 1970 00:00:00 AM UTC\n");
+  while (g->written < size)
+    {
+      size_t before = g->written;
+      int i, n = 1 + rnd (4);
+      for (i = 0; i != n; ++i)
+        {
+          out (g, "\033[01;3%dm", 1 + (int) rnd (7));
+          words (g, 1 + rnd (40));
+          out (g, "\033[0m\r\n");
+        }
+      fprintf (g->timings, "%lu.%06lu %lu\n", rnd (2), rnd (1000000),
+               (unsigned long) (g->written - before));
+    }
+}
+
+struct workload
+{
+  const char *name;
+  void (*generate) (struct gen *, size_t);
+  const char *option;           /* Extra option for teseq, if any. */
+  int timed;                    /* Needs a timings file. */
+};
+
+static const struct workload workloads[] = {
+  { "text", gen_text, NULL, 0 },
+  { "sgr", gen_sgr, NULL, 0 },
+  { "color", gen_sgr, "--color=always", 0 },
+  { "curses", gen_curses, NULL, 0 },
+  { "utf8", gen_utf8, NULL, 0 },
+  { "osc", gen_osc, NULL, 0 },
+  { "timings", gen_timings, NULL, 1 }
+};
+
+static void
+usage (int status)
+{
+  FILE *f = status == EXIT_SUCCESS ? stdout : stderr;
+  size_t i;
+
+  fputs ("\
+Usage: teseq-bench [-n RUNS] [-s SIZE] [WORKLOAD...]\n\
+Run teseq over generated workloads, and report its throughput.\n", f);
+  putc ('\n', f);
+  fprintf (f, "\
+ -h         Display usage information (this message).\n\
+ -n RUNS    Run each workload RUNS times, and report the best\n\
+            (default %d).\n\
+ -s SIZE    Generate SIZE bytes for each workload (default %lu). SIZE\n\
+            may end in k or M.\n", DEFAULT_RUNS, DEFAULT_SIZE);
+  putc ('\n', f);
+  fputs ("The workloads are:", f);
+  for (i = 0; i != N_ARY_ELEMS (workloads); ++i)
+    fprintf (f, " %s", workloads[i].name);
+  fputs (".\n\
+By default, all of them are run.\n", f);
+  putc ('\n', f);
+  fputs ("\
+Results are written as tab-separated values, one line per workload,\n\
+after a header line. The allocations are those made by a single run,\n\
+or -1 if they could not be counted.\n", f);
+  exit (status);
+}
+
+/* Create an empty temporary file, and return its name. */
+static char *
+make_temp (FILE **f)
+{
+  const char *dir = getenv ("TMPDIR");
+  char *name;
+  int fd;
+
+  if (!dir || !*dir)
+    dir = "/tmp";
+  name = malloc (strlen (dir) + sizeof "/teseq-bench-XXXXXX");
+  if (!name)
+    {
+      fprintf (stderr, "%s: Out of memory.\n", program_name);
+      exit (EXIT_FAILURE);
+    }
+  sprintf (name, "%s/teseq-bench-XXXXXX", dir);
+  fd = mkstemp (name);
+  if (fd == -1 || !(*f = fdopen (fd, "w")))
+    {
+      fprintf (stderr, "%s: couldn't create %s: %s\n", program_name,
+               name, strerror (errno));
+      exit (EXIT_FAILURE);
+    }
+  return name;
+}
+
+static void
+close_temp (FILE *f, const char *name)
+{
+  if (fclose (f) != 0)
+    {
+      fprintf (stderr, "%s: %s: %s\n", program_name, name,
+               strerror (errno));
+      remove (name);
+      exit (EXIT_FAILURE);
+    }
+}
+
+/* Run teseq once over INPUT. Returns the time taken, in seconds. */
+static double
+run (const struct workload *w, char *input, char *timings,
+     long *allocs)
+{
+  char *argv[8];
+  int argc = 0;
+  struct timeval start, end;
+
+  argv[argc++] = "teseq";
+  argv[argc++] = "-I";
+  if (w->option)
+    argv[argc++] = (char *)w->option;
+  if (timings)
+    {
+      argv[argc++] = "-t";
+      argv[argc++] = timings;
+    }
+  argv[argc++] = input;
+  argv[argc++] = "/dev/null";
+  argv[argc] = NULL;
+
+  optind = 1;
+#ifdef HAVE_LD_WRAP
+  allocations = 0;
+#endif
+  gettimeofday (&start, NULL);
+  teseq_main (argc, argv);
+  gettimeofday (&end, NULL);
+#ifdef HAVE_LD_WRAP
+  *allocs = allocations;
+#else
+  *allocs = -1;
+#endif
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+}
+
+static void
+bench (const struct workload *w, size_t size, int runs)
+{
+  struct gen g = { NULL, NULL, 0 };
+  char *input, *timings = NULL;
+  double best = 0.0;
+  long allocs = -1;
+  int i;
+
+  seed = 1;
+  input = make_temp (&g.f);
+  if (w->timed)
+    timings = make_temp (&g.timings);
+  w->generate (&g, size);
+  close_temp (g.f, input);
+  if (w->timed)
+    close_temp (g.timings, timings);
+
+  for (i = 0; i != runs; ++i)
+    {
+      double t = run (w, input, timings, &allocs);
+      if (i == 0 || t < best)
+        best = t;
+    }
+  if (best <= 0.0)
+    best = 1e-6;
+
+  printf ("%s\t%lu\t%d\t%.6f\t%.2f\t%.2f\t%ld\n", w->name,
+          (unsigned long) g.written, runs, best, g.written / best / 1e6,
+          best * 1e9 / g.written, allocs);
+  fflush (stdout);
+
+  remove (input);
+  free (input);
+  if (timings)
+    {
+      remove (timings);
+      free (timings);
+    }
+}
+
+static size_t
+parse_size (const char *arg)
+{
+  char *end;
+  unsigned long n;
+
+  errno = 0;
+  n = strtoul (arg, &end, 10);
+  if (*end == 'k' || *end == 'K')
+    n *= 1024, ++end;
+  else if (*end == 'M')
+    n *= 1024 * 1024, ++end;
+  if (errno || end == arg || *end != '\0' || n == 0)
+    {
+      fprintf (stderr, "Option -s: Invalid size ``%s''.\n\n", arg);
+      usage (EXIT_FAILURE);
+    }
+  return n;
+}
+
+int
+main (int argc, char **argv)
+{
+  int opt;
+  int runs = DEFAULT_RUNS;
+  size_t size = DEFAULT_SIZE;
+  size_t i;
+
+  program_name = argv[0];
+  while ((opt = getopt (argc, argv, "hn:s:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'h':
+          usage (EXIT_SUCCESS);
+          break;
+        case 'n':
+          runs = atoi (optarg);
+          if (runs <= 0)
+            {
+              fprintf (stderr, "Option -n: Invalid count ``%s''.\n\n",
+                       optarg);
+              usage (EXIT_FAILURE);
+            }
+          break;
+        case 's':
+          size = parse_size (optarg);
+          break;
+        default:
+          putc ('\n', stderr);
+          usage (EXIT_FAILURE);
+          break;
+        }
+    }
+  for (i = optind; argv[i]; ++i)
+    {
+      size_t j;
+      for (j = 0; j != N_ARY_ELEMS (workloads); ++j)
+        if (!strcmp (argv[i], workloads[j].name))
+          break;
+      if (j == N_ARY_ELEMS (workloads))
+        {
+          fprintf (stderr, "%s: Unknown workload ``%s''.\n\n",
+                   program_name, argv[i]);
+          usage (EXIT_FAILURE);
+        }
+    }
+
+  printf ("# %s\n", PACKAGE_STRING);
+  printf ("workload\tbytes\truns\tseconds\tmb_per_s\tns_per_byte"
+          "\tallocations\n");
+  if (argv[optind] == NULL)
+    for (i = 0; i != N_ARY_ELEMS (workloads); ++i)
+      bench (&workloads[i], size, runs);
+  else
+    for (i = optind; argv[i]; ++i)
+      {
+        size_t j;
+        for (j = 0; strcmp (argv[i], workloads[j].name); ++j)
+          ;
+        bench (&workloads[j], size, runs);
+      }
+  return EXIT_SUCCESS;
+}
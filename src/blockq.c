@@ -0,0 +1,275 @@
+/* blockq.c: a queue of blocks between two threads. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "teseq.h"
+
+#include <stdlib.h>
+
+#include "blockq.h"
+
+#ifdef HAVE_BLOCKQ
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* How many times to look again before going to sleep, when waiting. */
+#define SPIN_COUNT      100
+
+/* Keeps what each side writes off the other's cache lines. */
+#define CACHE_LINE      64
+
+struct blockq
+{
+  size_t count;                 /* Number of blocks. */
+  size_t size;                  /* Size of each. */
+  unsigned char *data;          /* count * size bytes. */
+  size_t *lens;                 /* Length of the data in each. */
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+
+  /* Blocks committed and released so far. Each is only changed by one
+     side, so the blocks between them belong to the consumer, and the
+     rest to the producer, without locking. Each side also keeps the
+     last value it saw of the other's count, and only looks at the
+     real one again when that isn't enough. */
+  char pad0[CACHE_LINE];
+  atomic_size_t committed;
+  size_t released_seen;         /* The producer's. */
+  char pad1[CACHE_LINE];
+  atomic_size_t released;
+  size_t committed_seen;        /* The consumer's. */
+  size_t taken;                 /* Blocks taken, not yet released. */
+  char pad2[CACHE_LINE];
+  /* Only a side that has to sleep sets these. */
+  atomic_int producer_waiting;
+  atomic_int consumer_waiting;
+  char pad3[CACHE_LINE];
+};
+
+struct blockq *
+blockq_new (size_t count, size_t size)
+{
+  struct blockq *q = malloc (sizeof *q);
+
+  if (!q)
+    return NULL;
+  q->count = count;
+  q->size = size;
+  q->data = malloc (count * size);
+  q->lens = malloc (count * sizeof *q->lens);
+  if (!q->data || !q->lens)
+    {
+      free (q->data);
+      free (q->lens);
+      free (q);
+      return NULL;
+    }
+  atomic_init (&q->committed, 0);
+  atomic_init (&q->released, 0);
+  q->released_seen = q->committed_seen = 0;
+  q->taken = 0;
+  atomic_init (&q->producer_waiting, 0);
+  atomic_init (&q->consumer_waiting, 0);
+  pthread_mutex_init (&q->lock, NULL);
+  pthread_cond_init (&q->changed, NULL);
+  return q;
+}
+
+void
+blockq_delete (struct blockq *q)
+{
+  pthread_mutex_destroy (&q->lock);
+  pthread_cond_destroy (&q->changed);
+  free (q->data);
+  free (q->lens);
+  free (q);
+}
+
+size_t
+blockq_block_size (const struct blockq *q)
+{
+  return q->size;
+}
+
+/* Wait until READY (q) is true. The other side calls wake, with the
+   same WAITING flag, after each change it makes. */
+static void
+wait_for (struct blockq *q, int (*ready) (struct blockq *),
+          atomic_int *waiting)
+{
+  int i;
+
+  for (i = 0; i != SPIN_COUNT; ++i)
+    if (ready (q))
+      return;
+  pthread_mutex_lock (&q->lock);
+  for (;;)
+    {
+      /* Say we're going to sleep before the last look, so that the
+         other side either sees that, or its change is seen here. */
+      atomic_store (waiting, 1);
+      atomic_thread_fence (memory_order_seq_cst);
+      if (ready (q))
+        break;
+      pthread_cond_wait (&q->changed, &q->lock);
+    }
+  atomic_store (waiting, 0);
+  pthread_mutex_unlock (&q->lock);
+}
+
+static void
+wake (struct blockq *q, atomic_int *waiting)
+{
+  if (atomic_load (waiting))
+    {
+      pthread_mutex_lock (&q->lock);
+      pthread_cond_signal (&q->changed);
+      pthread_mutex_unlock (&q->lock);
+    }
+}
+
+/* Producer: are there free blocks? */
+static int
+has_free (struct blockq *q)
+{
+  size_t committed = atomic_load_explicit (&q->committed,
+                                           memory_order_relaxed);
+  if (committed - q->released_seen != q->count)
+    return 1;
+  q->released_seen = atomic_load_explicit (&q->released,
+                                           memory_order_acquire);
+  return committed - q->released_seen != q->count;
+}
+
+/* Consumer: are there full blocks? */
+static int
+has_full (struct blockq *q)
+{
+  size_t released = atomic_load_explicit (&q->released,
+                                          memory_order_relaxed);
+  if (q->committed_seen != released)
+    return 1;
+  q->committed_seen = atomic_load_explicit (&q->committed,
+                                            memory_order_acquire);
+  return q->committed_seen != released;
+}
+
+/* Wait for free blocks, and return as many as follow each other in
+   memory, for filling: *N of them, that is, *N times the block size
+   in bytes. */
+unsigned char *
+blockq_claim_span (struct blockq *q, size_t *n)
+{
+  size_t committed = atomic_load_explicit (&q->committed,
+                                           memory_order_relaxed);
+  size_t first = committed % q->count;
+  size_t free;
+
+  if (!has_free (q))
+    wait_for (q, has_free, &q->producer_waiting);
+  free = q->count - (committed - q->released_seen);
+  if (free > q->count - first)
+    free = q->count - first;
+  *n = free;
+  return q->data + first * q->size;
+}
+
+/* Wait for a free block, and return it for filling. */
+unsigned char *
+blockq_claim (struct blockq *q)
+{
+  size_t n;
+  return blockq_claim_span (q, &n);
+}
+
+/* Hand over the claimed blocks, holding LEN bytes: as many blocks as
+   that fills, or one empty one if LEN is zero. */
+void
+blockq_commit (struct blockq *q, size_t len)
+{
+  size_t committed = atomic_load_explicit (&q->committed,
+                                           memory_order_relaxed);
+  size_t i = committed % q->count;
+
+  do
+    {
+      size_t n = len < q->size ? len : q->size;
+      q->lens[i++] = n;
+      len -= n;
+      ++committed;
+    }
+  while (len);
+  atomic_store (&q->committed, committed);
+  wake (q, &q->consumer_waiting);
+}
+
+/* Wait for full blocks, and return as many as follow each other in
+   memory with nothing missing between them, with the length of their
+   data in *LEN. A *LEN of zero marks the end. */
+const unsigned char *
+blockq_take_span (struct blockq *q, size_t *len)
+{
+  size_t released = atomic_load_explicit (&q->released,
+                                          memory_order_relaxed);
+  size_t first = released % q->count;
+  size_t avail;
+  size_t i;
+
+  if (!has_full (q))
+    wait_for (q, has_full, &q->consumer_waiting);
+  avail = q->committed_seen - released;
+  if (avail > q->count - first)
+    avail = q->count - first;
+  *len = q->lens[first];
+  for (i = 1; i != avail && q->lens[first + i - 1] == q->size
+         && q->lens[first + i] != 0; ++i)
+    *len += q->lens[first + i];
+  q->taken = i;
+  return q->data + first * q->size;
+}
+
+/* Wait for the next full block, and return it, with its length in
+   *LEN. */
+const unsigned char *
+blockq_take (struct blockq *q, size_t *len)
+{
+  size_t released = atomic_load_explicit (&q->released,
+                                          memory_order_relaxed);
+
+  if (!has_full (q))
+    wait_for (q, has_full, &q->consumer_waiting);
+  q->taken = 1;
+  *len = q->lens[released % q->count];
+  return q->data + released % q->count * q->size;
+}
+
+/* Give back the blocks just taken. */
+void
+blockq_release (struct blockq *q)
+{
+  size_t released = atomic_load_explicit (&q->released,
+                                          memory_order_relaxed);
+  atomic_store (&q->released, released + q->taken);
+  q->taken = 0;
+  wake (q, &q->producer_waiting);
+}
+
+#endif /* HAVE_BLOCKQ */
@@ -0,0 +1,63 @@
+/* blockq.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    A queue of blocks, for handing data from one thread to another.
+
+    The blocks are allocated up front, and go round in a ring: the
+    producer claims the next free block, fills it, and commits it; the
+    consumer takes the next full block, uses it, and gives it back.
+    There is just one producer and one consumer, each keeping its own
+    count of blocks passed along, so neither takes a lock unless the
+    ring is full (or empty) and it has to sleep. A committed block of
+    length zero marks the end of the data.
+
+    Either side can also deal in spans of blocks that follow each
+    other in memory: the producer can fill several free blocks with
+    one read, and the consumer can take several full ones, as long as
+    each but the last is completely full, to use in one go. The
+    counts each side writes are kept on cache lines of their own.
+*/
+
+#ifndef BLOCKQ_H
+#define BLOCKQ_H
+
+#include "teseq.h"
+
+#if defined (HAVE_PTHREAD_H) && defined (HAVE_STDATOMIC_H)
+#  define HAVE_BLOCKQ   1
+#endif
+
+struct blockq;
+
+struct blockq *blockq_new (size_t count, size_t size);
+void blockq_delete (struct blockq *);
+size_t blockq_block_size (const struct blockq *);
+
+unsigned char *blockq_claim (struct blockq *);
+unsigned char *blockq_claim_span (struct blockq *, size_t *n);
+void blockq_commit (struct blockq *, size_t len);
+
+const unsigned char *blockq_take (struct blockq *, size_t *len);
+const unsigned char *blockq_take_span (struct blockq *, size_t *len);
+void blockq_release (struct blockq *);
+
+#endif
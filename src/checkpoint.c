@@ -0,0 +1,110 @@
+/* checkpoint.c: saving and loading the state for --checkpoint. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkpoint.h"
+
+extern const char *program_name;
+
+#define CHECKPOINT_MAGIC        "teseq checkpoint 1\n"
+
+/* Read the checkpoint at PATH into CK. Returns 1 if there was one, 0
+   if there's no such file yet, or -1 (having said why) if it can't be
+   read or doesn't make sense. */
+int
+checkpoint_read (const char *path, struct checkpoint *ck)
+{
+  FILE *f = fopen (path, "r");
+  char magic[sizeof CHECKPOINT_MAGIC];
+  uintmax_t dev, ino, offset, column;
+  int n;
+
+  if (!f && errno == ENOENT)
+    return 0;
+  if (!f)
+    {
+      fprintf (stderr, "%s: couldn't open file %s: %s\n", program_name,
+               path, strerror (errno));
+      return -1;
+    }
+  n = -1;
+  if (fgets (magic, sizeof magic, f) && strcmp (magic, CHECKPOINT_MAGIC) == 0)
+    n = fscanf (f, "file %ju %ju\noffset %ju\nstate %d %d\ncolumn %ju\n",
+                &dev, &ino, &offset, &ck->state, &ck->print_dot, &column);
+  fclose (f);
+  if (n != 6 || ck->state < 0 || ck->state > 2
+      || (off_t) offset < 0 || (uintmax_t) (off_t) offset != offset)
+    {
+      fprintf (stderr, "%s: %s isn't a checkpoint file.\n", program_name,
+               path);
+      return -1;
+    }
+  ck->dev = dev;
+  ck->ino = ino;
+  ck->offset = offset;
+  ck->column = column;
+  return 1;
+}
+
+/* Write CK to the checkpoint at PATH, replacing the old one all at
+   once, so that a run that's interrupted leaves it as it was. Returns
+   0 on success, or -1 (having said why) on an error. */
+int
+checkpoint_write (const char *path, const struct checkpoint *ck)
+{
+  size_t len = strlen (path);
+  char *tmp = malloc (len + sizeof ".new");
+  FILE *f = NULL;
+  int ok;
+
+  if (tmp)
+    {
+      memcpy (tmp, path, len);
+      strcpy (tmp + len, ".new");
+      f = fopen (tmp, "w");
+    }
+  ok = f != NULL;
+  if (ok)
+    {
+      fputs (CHECKPOINT_MAGIC, f);
+      fprintf (f, "file %ju %ju\noffset %ju\nstate %d %d\ncolumn %ju\n",
+               (uintmax_t) ck->dev, (uintmax_t) ck->ino,
+               (uintmax_t) ck->offset, ck->state, ck->print_dot,
+               (uintmax_t) ck->column);
+      ok = fclose (f) == 0 && rename (tmp, path) == 0;
+    }
+  if (!ok)
+    {
+      fprintf (stderr, "%s: couldn't write checkpoint %s: %s\n",
+               program_name, path, tmp ? strerror (errno) : "Out of memory");
+      if (f)
+        remove (tmp);
+    }
+  free (tmp);
+  return ok ? 0 : -1;
+}
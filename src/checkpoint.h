@@ -0,0 +1,62 @@
+/* checkpoint.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Checkpoints, for resuming.
+
+    With --checkpoint, teseq doesn't finish off its output at the end
+    of the input, but writes what it would need to carry on to a small
+    file: how far it got through the input, and the line it was in the
+    middle of writing, if any. The next run with the same checkpoint
+    file starts reading the input from there, and carries on as if it
+    had never stopped, so a file that keeps growing (a log, say) can be
+    decoded a piece at a time, with the output of each run appended to
+    the last. An escape sequence that isn't all there yet is left to
+    be read again next time.
+
+    The checkpoint also says which file it was for. If the input turns
+    out to be a different file (as after a log is rotated), or shorter
+    than the checkpoint's place in it, the old output is finished off,
+    and the new input is read from the start.
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "teseq.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+struct checkpoint
+{
+  dev_t dev;                    /* The input file. */
+  ino_t ino;
+  off_t offset;                 /* How much of it has been decoded. */
+  int state;                    /* The decoder's state, */
+  int print_dot;
+  size_t column;                /* and the line it was writing. */
+};
+
+int checkpoint_read (const char *path, struct checkpoint *);
+int checkpoint_write (const char *path, const struct checkpoint *);
+
+#endif
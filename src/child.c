@@ -0,0 +1,282 @@
+/* child.c: running a command under a pseudo-terminal, for --command. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* For posix_openpt and friends. */
+#define _GNU_SOURCE
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "child.h"
+
+extern const char *program_name;
+
+#ifdef HAVE_CHILD
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "passthrough.h"
+#include "record.h"
+#include "tty.h"
+
+/* The most that is taken from the command, or the user, at a time. */
+#define READ_SIZE       16384
+
+static volatile sig_atomic_t winch_pending;
+
+static void
+catch_winch (int s)
+{
+  (void) s;
+  winch_pending = 1;
+}
+
+static void
+copy_winsize (int from, int to)
+{
+  struct winsize ws;
+
+  if (ioctl (from, TIOCGWINSZ, &ws) == 0)
+    ioctl (to, TIOCSWINSZ, &ws);
+}
+
+static int
+write_all (int fd, const unsigned char *buf, size_t len)
+{
+  while (len)
+    {
+      ssize_t n = write (fd, buf, len);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1)
+        return -1;
+      buf += n;
+      len -= n;
+    }
+  return 0;
+}
+
+/* Start ARGV[0] on a new pseudo-terminal, set up like the user's own.
+   Returns the command's process ID, with the terminal's master side
+   in *MASTERP, or -1 on an error. */
+static pid_t
+spawn (char **argv, int *masterp)
+{
+  struct termios ti;
+  const char *name = NULL;
+  int master;
+  int slave = -1;
+  pid_t pid;
+
+  master = posix_openpt (O_RDWR | O_NOCTTY);
+  if (master != -1 && grantpt (master) == 0 && unlockpt (master) == 0)
+    name = ptsname (master);
+  /* The slave side is opened here, so that it's never without a
+     user (which would make reading the master side fail) until the
+     command and everything it starts are done with it. */
+  if (name != NULL)
+    slave = open (name, O_RDWR | O_NOCTTY);
+  if (slave == -1)
+    {
+      if (master != -1)
+        close (master);
+      return -1;
+    }
+  if (tcgetattr (STDIN_FILENO, &ti) == 0)
+    tcsetattr (slave, TCSANOW, &ti);
+  copy_winsize (STDIN_FILENO, slave);
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      setsid ();
+#ifdef TIOCSCTTY
+      ioctl (slave, TIOCSCTTY, 0);
+#else
+      /* The first terminal opened by a session leader becomes its
+         controlling terminal. */
+      close (open (name, O_RDWR));
+#endif
+      dup2 (slave, STDIN_FILENO);
+      dup2 (slave, STDOUT_FILENO);
+      dup2 (slave, STDERR_FILENO);
+      if (slave > STDERR_FILENO)
+        close (slave);
+      close (master);
+      execvp (argv[0], argv);
+      fprintf (stderr, "%s: %s: %s\n", program_name, argv[0],
+               strerror (errno));
+      _exit (127);
+    }
+  close (slave);
+  if (pid == -1)
+    {
+      close (master);
+      return -1;
+    }
+  *masterp = master;
+  return pid;
+}
+
+/* The user's input has ended: pass that on, as the end-of-file
+   character. */
+static void
+send_eof (int master)
+{
+  struct termios ti;
+  unsigned char c;
+
+  if (tcgetattr (master, &ti) == 0)
+    {
+      c = ti.c_cc[VEOF];
+      write_all (master, &c, 1);
+    }
+}
+
+/* Run the command given by CFG, passing it the user's input, and
+   feeding its output to P (and copying it to OUTFD, for
+   --passthrough). Returns the command's exit status. */
+int
+child_run (struct processor *p, const struct config *cfg, int outfd)
+{
+  unsigned char buf[READ_SIZE];
+  struct pollfd fds[2];
+  struct sigaction sa;
+  struct recorder rec;
+  int in_open = 1;
+  int ended = 0;
+  int master;
+  int status;
+  pid_t pid;
+
+  pid = spawn (cfg->command, &master);
+  if (pid == -1)
+    {
+      fprintf (stderr, "%s: couldn't run %s: %s\n", program_name,
+               cfg->command[0], strerror (errno));
+      return EXIT_FAILURE;
+    }
+
+  /* Keep the command's terminal the same size as the user's. */
+  sigemptyset (&sa.sa_mask);
+  sa.sa_handler = catch_winch;
+  sa.sa_flags = 0;
+  sigaction (SIGWINCH, &sa, NULL);
+  if (isatty (STDIN_FILENO))
+    tty_raw (STDIN_FILENO, cfg->passthrough != NULL);
+
+  recorder_start (&rec, cfg);
+
+  for (;;)
+    {
+      ssize_t n;
+
+      if (winch_pending)
+        {
+          winch_pending = 0;
+          copy_winsize (STDIN_FILENO, master);
+        }
+      fds[0].fd = in_open ? STDIN_FILENO : -1;
+      fds[0].events = POLLIN;
+      fds[1].fd = master;
+      fds[1].events = POLLIN;
+      if (poll (fds, 2, -1) == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          break;
+        }
+
+      if (fds[1].revents)
+        {
+          double wait;
+
+          n = read (master, buf, sizeof buf);
+          if (n == -1 && errno == EINTR)
+            continue;
+          /* Once the command (and anything it started) has closed
+             the terminal, this fails with EIO. */
+          if (n <= 0)
+            {
+              ended = 1;
+              break;
+            }
+          wait = recorder_read (&rec, buf, n);
+          if (cfg->timestamp)
+            processor_delay (p, wait);
+          if (!cfg->passthrough)
+            processor_feed (p, buf, n);
+          else if (passthrough_copy (p, outfd, buf, n) != 0)
+            break;
+        }
+      if (in_open && fds[0].revents)
+        {
+          n = read (STDIN_FILENO, buf, sizeof buf);
+          if (n == -1 && errno == EINTR)
+            continue;
+          if (n <= 0)
+            {
+              in_open = 0;
+              send_eof (master);
+            }
+          else
+            write_all (master, buf, n);
+        }
+    }
+  processor_feed (p, NULL, 0);
+  recorder_end (&rec);
+  tty_restore ();
+
+  /* Closing the terminal hangs it up, so if the command may still be
+     on its way out, let it finish first. */
+  if (!ended)
+    close (master);
+  while (waitpid (pid, &status, 0) == -1)
+    if (errno != EINTR)
+      return EXIT_FAILURE;
+  if (ended)
+    close (master);
+  if (WIFEXITED (status))
+    return WEXITSTATUS (status);
+  return 128 + WTERMSIG (status);
+}
+
+#else
+
+int
+child_run (struct processor *p, const struct config *cfg, int outfd)
+{
+  fprintf (stderr, "%s: --command isn't supported on this system.\n",
+           program_name);
+  return EXIT_FAILURE;
+}
+
+#endif /* HAVE_CHILD */
@@ -0,0 +1,46 @@
+/* child.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Running a command.
+
+    With --command, teseq runs a command under a pseudo-terminal of
+    its own, instead of reading a file, so the command sees a terminal
+    just as it would if run directly. What the user types is passed on
+    to it, and whatever it writes is decoded as it arrives (and, with
+    --passthrough, copied to the user's terminal as well). Each read
+    from the pseudo-terminal can be recorded, along with the time it
+    was made, as a typescript and timings file for -t, as script(1)
+    would write them.
+*/
+
+#ifndef CHILD_H
+#define CHILD_H
+
+#include "teseq.h"
+
+#if defined (HAVE_POSIX_OPENPT) && defined (HAVE_SYS_WAIT_H)
+#  define HAVE_CHILD    1
+#endif
+
+int child_run (struct processor *, const struct config *, int outfd);
+
+#endif
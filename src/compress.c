@@ -0,0 +1,366 @@
+/* compress.c: compressing the output, for --output-compress. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* For fopencookie. */
+#define _GNU_SOURCE
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compress.h"
+
+extern const char *program_name;
+
+#ifdef HAVE_COMPRESS
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#ifdef HAVE_ZLIB_H
+#  include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD_H
+#  include <zstd.h>
+#endif
+
+/* The blocks of uncompressed output, and how many can be waiting. */
+#define BLOCK_SIZE      65536
+#define BLOCK_COUNT     8
+
+/* The compressed output is written in pieces of this size. */
+#define WRITE_SIZE      262144
+
+struct deflater
+{
+  FILE *orig;                   /* The stream being replaced. */
+  int fd;
+  int format;
+  int level;
+  struct blockq *q;
+  unsigned char *block;         /* The block being filled, if any, */
+  size_t fill;                  /* and how much of it is. */
+  pthread_t tid;
+  unsigned char *out;           /* WRITE_SIZE bytes, for the thread. */
+  atomic_int err;               /* An errno value, once writing fails. */
+};
+
+/* Write the LEN bytes at BUF, unless writing has failed already. */
+static void
+write_buf (struct deflater *d, const unsigned char *buf, size_t len)
+{
+  while (len && !atomic_load (&d->err))
+    {
+      ssize_t n = write (d->fd, buf, len);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1)
+        atomic_store (&d->err, errno);
+      else
+        {
+          buf += n;
+          len -= n;
+        }
+    }
+}
+
+/* Write the blocks as they are, as many at a time as are waiting. */
+static int
+copy_plain (struct deflater *d)
+{
+  const unsigned char *buf;
+  size_t len;
+
+  do
+    {
+      buf = blockq_take_span (d->q, &len);
+      write_buf (d, buf, len);
+      blockq_release (d->q);
+    }
+  while (len);
+  return 0;
+}
+
+#ifdef HAVE_ZLIB_H
+static int
+deflate_gzip (struct deflater *d)
+{
+  z_stream zs;
+  size_t len;
+
+  memset (&zs, 0, sizeof zs);
+  /* 16: write a gzip header. */
+  if (deflateInit2 (&zs, d->level, Z_DEFLATED, 15 + 16, 8,
+                    Z_DEFAULT_STRATEGY) != Z_OK)
+    return -1;
+  zs.next_out = d->out;
+  zs.avail_out = WRITE_SIZE;
+  do
+    {
+      int flush;
+      int r;
+
+      zs.next_in = (unsigned char *) blockq_take (d->q, &len);
+      zs.avail_in = len;
+      flush = len ? Z_NO_FLUSH : Z_FINISH;
+      do
+        {
+          r = deflate (&zs, flush);
+          if (zs.avail_out == 0 || r == Z_STREAM_END)
+            {
+              write_buf (d, d->out, WRITE_SIZE - zs.avail_out);
+              zs.next_out = d->out;
+              zs.avail_out = WRITE_SIZE;
+            }
+        }
+      while (flush == Z_FINISH ? r != Z_STREAM_END : zs.avail_in != 0);
+      blockq_release (d->q);
+    }
+  while (len);
+  deflateEnd (&zs);
+  return 0;
+}
+#endif
+
+#ifdef HAVE_ZSTD_H
+static int
+deflate_zstd (struct deflater *d)
+{
+  ZSTD_CStream *cs = ZSTD_createCStream ();
+  ZSTD_outBuffer ob;
+  size_t len;
+
+  if (!cs || ZSTD_isError (ZSTD_initCStream (cs, d->level)))
+    {
+      ZSTD_freeCStream (cs);
+      return -1;
+    }
+  ob.dst = d->out;
+  ob.size = WRITE_SIZE;
+  ob.pos = 0;
+  do
+    {
+      ZSTD_inBuffer ib;
+      size_t r;
+
+      ib.src = blockq_take (d->q, &len);
+      ib.size = len;
+      ib.pos = 0;
+      do
+        {
+          r = len ? ZSTD_compressStream (cs, &ob, &ib)
+                  : ZSTD_endStream (cs, &ob);
+          if (ZSTD_isError (r))
+            {
+              /* Drop the rest. */
+              atomic_store (&d->err, EIO);
+              break;
+            }
+          if (ob.pos == ob.size || (!len && r == 0))
+            {
+              write_buf (d, d->out, ob.pos);
+              ob.pos = 0;
+            }
+        }
+      while (len ? ib.pos != ib.size : r != 0);
+      blockq_release (d->q);
+    }
+  while (len);
+  ZSTD_freeCStream (cs);
+  return 0;
+}
+#endif
+
+static void *
+deflate_output (void *arg)
+{
+  struct deflater *d = arg;
+  int r = -1;
+
+  if (d->format == CFG_COMPRESS_NONE)
+    r = copy_plain (d);
+#ifdef HAVE_ZLIB_H
+  if (d->format == CFG_COMPRESS_GZIP)
+    r = deflate_gzip (d);
+#endif
+#ifdef HAVE_ZSTD_H
+  if (d->format == CFG_COMPRESS_ZSTD)
+    r = deflate_zstd (d);
+#endif
+  if (r != 0)
+    {
+      size_t len;
+
+      /* Keep taking the output, so the writer doesn't wait forever. */
+      atomic_store (&d->err, ENOMEM);
+      do
+        {
+          blockq_take (d->q, &len);
+          blockq_release (d->q);
+        }
+      while (len);
+    }
+  return NULL;
+}
+
+static ssize_t
+cookie_write (void *cookie, const char *buf, size_t size)
+{
+  struct deflater *d = cookie;
+  size_t done = 0;
+  int err = atomic_load (&d->err);
+
+  if (err)
+    {
+      errno = err;
+      return -1;
+    }
+  while (done != size)
+    {
+      size_t n = size - done;
+
+      if (!d->block)
+        d->block = blockq_claim (d->q);
+      if (n > BLOCK_SIZE - d->fill)
+        n = BLOCK_SIZE - d->fill;
+      memcpy (d->block + d->fill, buf + done, n);
+      d->fill += n;
+      done += n;
+      if (d->fill == BLOCK_SIZE)
+        {
+          blockq_commit (d->q, d->fill);
+          d->block = NULL;
+          d->fill = 0;
+        }
+    }
+  return done;
+}
+
+static int
+cookie_close (void *cookie)
+{
+  struct deflater *d = cookie;
+  int err;
+
+  if (d->fill)
+    blockq_commit (d->q, d->fill);
+  blockq_claim (d->q);
+  blockq_commit (d->q, 0);
+  pthread_join (d->tid, NULL);
+
+  err = atomic_load (&d->err);
+  if (d->orig != stdout && fclose (d->orig) != 0 && !err)
+    err = errno;
+  blockq_delete (d->q);
+  free (d->out);
+  free (d);
+  if (err)
+    {
+      errno = err;
+      return -1;
+    }
+  return 0;
+}
+
+/* Return a stream whose output is compressed in FORMAT (one of
+   CFG_COMPRESS_*, or CFG_COMPRESS_NONE to just write it on another
+   thread), at LEVEL (or the format's default, if it's -1), and
+   written to F. Returns NULL, having said why, on an error. */
+FILE *
+compress_open (FILE *f, int format, int level)
+{
+  cookie_io_functions_t funcs = { NULL, NULL, NULL, NULL };
+  struct deflater *d;
+  FILE *w;
+
+#ifndef HAVE_ZLIB_H
+  if (format == CFG_COMPRESS_GZIP)
+    goto unsupported;
+#endif
+#ifndef HAVE_ZSTD_H
+  if (format == CFG_COMPRESS_ZSTD)
+    goto unsupported;
+#endif
+  d = calloc (1, sizeof *d);
+  if (!d)
+    goto nomem;
+  d->orig = f;
+  d->fd = fileno (f);
+  d->format = format;
+  d->level = level;
+  if (level == -1)
+    d->level = format == CFG_COMPRESS_GZIP ? 6 : 3;
+  atomic_init (&d->err, 0);
+  d->q = blockq_new (BLOCK_COUNT, BLOCK_SIZE);
+  if (format != CFG_COMPRESS_NONE)
+    d->out = malloc (WRITE_SIZE);
+  if (!d->q || (format != CFG_COMPRESS_NONE && !d->out))
+    {
+      if (d->q)
+        blockq_delete (d->q);
+      free (d->out);
+      free (d);
+      goto nomem;
+    }
+  if (pthread_create (&d->tid, NULL, deflate_output, d) != 0)
+    {
+      fprintf (stderr, "%s: couldn't start a thread\n", program_name);
+      blockq_delete (d->q);
+      free (d->out);
+      free (d);
+      return NULL;
+    }
+
+  funcs.write = cookie_write;
+  funcs.close = cookie_close;
+  w = fopencookie (d, "w", funcs);
+  if (!w)
+    goto nomem;
+  /* Hand the thread whole blocks. */
+  setvbuf (w, NULL, _IOFBF, BLOCK_SIZE);
+  return w;
+
+ nomem:
+  fprintf (stderr, "%s: Out of memory.\n", program_name);
+  return NULL;
+#if !defined (HAVE_ZLIB_H) || !defined (HAVE_ZSTD_H)
+ unsupported:
+  fprintf (stderr, "%s: --output-compress=%s isn't supported on this"
+           " system.\n", program_name,
+           format == CFG_COMPRESS_GZIP ? "gzip" : "zstd");
+  return NULL;
+#endif
+}
+
+#else
+
+FILE *
+compress_open (FILE *f, int format, int level)
+{
+  fprintf (stderr, "%s: --%s isn't supported on this system.\n",
+           program_name, format ? "output-compress" : "pipeline");
+  return NULL;
+}
+
+#endif /* HAVE_COMPRESS */
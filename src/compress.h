@@ -0,0 +1,49 @@
+/* compress.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Compressed output.
+
+    With --output-compress, the output stream is replaced by one whose
+    buffer is handed, a block at a time, through a blockq to a thread
+    that compresses it and writes the result to the real output file
+    in large pieces. Closing the stream finishes the compressed data,
+    and waits for it to be written. With --pipeline, output that isn't
+    compressed is written by the same thread, as many blocks at a time
+    as are waiting.
+*/
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "teseq.h"
+
+#include <stdio.h>
+
+#include "blockq.h"
+
+#if defined (HAVE_BLOCKQ) && defined (HAVE_FOPENCOOKIE)
+#  define HAVE_COMPRESS         1
+#endif
+
+FILE *compress_open (FILE *, int format, int level);
+
+#endif
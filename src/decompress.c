@@ -0,0 +1,327 @@
+/* decompress.c: reading the input on a thread of its own. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "decompress.h"
+
+extern const char *program_name;
+
+static const unsigned char gzip_magic[] = { 0x1f, 0x8b };
+static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+/* Return the compression (CFG_COMPRESS_*) of the regular file open on
+   FD, judging by the bytes at its current offset, which are left to
+   be read. Anything that isn't a regular file isn't looked at. */
+int
+decompress_detect (int fd)
+{
+  unsigned char magic[4];
+  const char *name = NULL;
+  struct stat st;
+  off_t off;
+  int found = CFG_COMPRESS_NONE;
+
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode)
+      || (off = lseek (fd, 0, SEEK_CUR)) == -1
+      || pread (fd, magic, sizeof magic, off) != sizeof magic)
+    return CFG_COMPRESS_NONE;
+
+  if (memcmp (magic, gzip_magic, sizeof gzip_magic) == 0)
+    {
+      name = "gzip";
+#if defined (HAVE_DECOMPRESS) && defined (HAVE_ZLIB_H)
+      found = CFG_COMPRESS_GZIP;
+#endif
+    }
+  else if (memcmp (magic, zstd_magic, sizeof zstd_magic) == 0)
+    {
+      name = "zstd";
+#if defined (HAVE_DECOMPRESS) && defined (HAVE_ZSTD_H)
+      found = CFG_COMPRESS_ZSTD;
+#endif
+    }
+  if (name && found == CFG_COMPRESS_NONE)
+    fprintf (stderr, "%s: The input is compressed with %s, which isn't"
+             " supported on this system; reading it as it is.\n",
+             program_name, name);
+  return found;
+}
+
+#ifdef HAVE_DECOMPRESS
+
+#include <pthread.h>
+#ifdef HAVE_ZLIB_H
+#  include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD_H
+#  include <zstd.h>
+#endif
+
+
+/* How much compressed input is read at a time. */
+#define READ_SIZE       65536
+
+/* The decompressed blocks, and how many can be waiting. */
+#define BLOCK_SIZE      65536
+#define BLOCK_COUNT     8
+
+struct inflater
+{
+  int fd;
+  int format;
+  struct blockq *q;
+  const char *error;            /* What went wrong, if anything. */
+};
+
+static ssize_t
+read_input (int fd, unsigned char *buf, size_t size)
+{
+  ssize_t n;
+
+  while ((n = read (fd, buf, size)) == -1 && errno == EINTR)
+    ;
+  return n;
+}
+
+/* Copy FD into Q as it is, filling as many blocks at a time as
+   there are free. */
+static const char *
+read_plain (int fd, struct blockq *q)
+{
+  for (;;)
+    {
+      size_t count;
+      unsigned char *span = blockq_claim_span (q, &count);
+      ssize_t n = read_input (fd, span, count * blockq_block_size (q));
+
+      if (n == -1)
+        return strerror (errno);
+      if (n == 0)
+        return NULL;
+      blockq_commit (q, n);
+    }
+}
+
+#ifdef HAVE_ZLIB_H
+/* Decompress gzip data (of one or more members) from FD into Q. */
+static const char *
+inflate_gzip (int fd, struct blockq *q, unsigned char *in)
+{
+  const char *error = NULL;
+  z_stream zs;
+  int ended = 0;                /* A member has ended, and the next
+                                   hasn't begun. */
+  int full = 0;
+
+  memset (&zs, 0, sizeof zs);
+  /* 32: accept a gzip or zlib header. */
+  if (inflateInit2 (&zs, 15 + 32) != Z_OK)
+    return "Out of memory";
+  for (;;)
+    {
+      size_t size = blockq_block_size (q);
+      int r;
+
+      /* A full block may have left more output to come without any
+         more input; but not once its member has ended. */
+      if (zs.avail_in == 0 && (!full || ended))
+        {
+          ssize_t n = read_input (fd, in, READ_SIZE);
+          if (n == -1)
+            {
+              error = strerror (errno);
+              break;
+            }
+          if (n == 0)
+            {
+              if (!ended)
+                error = "unexpected end of compressed data";
+              break;
+            }
+          zs.next_in = in;
+          zs.avail_in = n;
+        }
+      if (ended)
+        {
+          /* There's more input, so another member follows. */
+          inflateReset (&zs);
+          ended = 0;
+        }
+      zs.next_out = blockq_claim (q);
+      zs.avail_out = size;
+      r = inflate (&zs, Z_NO_FLUSH);
+      if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR)
+        {
+          error = zs.msg ? zs.msg : "invalid compressed data";
+          break;
+        }
+      full = zs.avail_out == 0;
+      if (zs.avail_out != size)
+        blockq_commit (q, size - zs.avail_out);
+      if (r == Z_STREAM_END)
+        ended = 1;
+    }
+  inflateEnd (&zs);
+  return error;
+}
+#endif
+
+#ifdef HAVE_ZSTD_H
+/* Decompress zstd data (of one or more frames) from FD into Q. */
+static const char *
+inflate_zstd (int fd, struct blockq *q, unsigned char *in)
+{
+  const char *error = NULL;
+  ZSTD_DStream *ds = ZSTD_createDStream ();
+  ZSTD_inBuffer ib = { NULL, 0, 0 };
+  size_t hint = 1;              /* Zero at the end of a frame, with
+                                   all of its output written. */
+  int full = 0;
+
+  if (!ds)
+    return "Out of memory";
+  ZSTD_initDStream (ds);
+  for (;;)
+    {
+      ZSTD_outBuffer ob;
+
+      if (ib.pos == ib.size && (!full || hint == 0))
+        {
+          ssize_t n = read_input (fd, in, READ_SIZE);
+          if (n == -1)
+            {
+              error = strerror (errno);
+              break;
+            }
+          if (n == 0)
+            {
+              if (hint != 0)
+                error = "unexpected end of compressed data";
+              break;
+            }
+          ib.src = in;
+          ib.size = n;
+          ib.pos = 0;
+        }
+      ob.dst = blockq_claim (q);
+      ob.size = blockq_block_size (q);
+      ob.pos = 0;
+      hint = ZSTD_decompressStream (ds, &ob, &ib);
+      if (ZSTD_isError (hint))
+        {
+          error = ZSTD_getErrorName (hint);
+          break;
+        }
+      full = ob.pos == ob.size;
+      if (ob.pos)
+        blockq_commit (q, ob.pos);
+    }
+  ZSTD_freeDStream (ds);
+  return error;
+}
+#endif
+
+static void *
+inflate_input (void *arg)
+{
+  struct inflater *inf = arg;
+  unsigned char *in = NULL;
+
+  if (inf->format == CFG_COMPRESS_NONE)
+    inf->error = read_plain (inf->fd, inf->q);
+  else if (!(in = malloc (READ_SIZE)))
+    inf->error = "Out of memory";
+#ifdef HAVE_ZLIB_H
+  else if (inf->format == CFG_COMPRESS_GZIP)
+    inf->error = inflate_gzip (inf->fd, inf->q, in);
+#endif
+#ifdef HAVE_ZSTD_H
+  else if (inf->format == CFG_COMPRESS_ZSTD)
+    inf->error = inflate_zstd (inf->fd, inf->q, in);
+#endif
+  free (in);
+  /* The end of the data. */
+  blockq_claim (inf->q);
+  blockq_commit (inf->q, 0);
+  return NULL;
+}
+
+/* Read the input on FD, decompressing it as given by CFG, and feed
+   it to P. Returns 0 on success, or -1 (having said why) on an
+   error. */
+int
+decompress_run (struct processor *p, const struct config *cfg, int fd)
+{
+  struct inflater inf;
+  pthread_t tid;
+  const unsigned char *buf;
+  size_t len;
+
+  inf.fd = fd;
+  inf.format = cfg->decompress;
+  inf.error = NULL;
+  inf.q = blockq_new (BLOCK_COUNT, BLOCK_SIZE);
+  if (!inf.q || pthread_create (&tid, NULL, inflate_input, &inf) != 0)
+    {
+      fprintf (stderr, "%s: couldn't start reading: %s\n",
+               program_name, inf.q ? "no threads" : "Out of memory");
+      if (inf.q)
+        blockq_delete (inf.q);
+      return -1;
+    }
+
+  while ((buf = blockq_take_span (inf.q, &len)), len != 0)
+    {
+      processor_feed (p, buf, len);
+      blockq_release (inf.q);
+    }
+  processor_feed (p, NULL, 0);
+  pthread_join (tid, NULL);
+  blockq_delete (inf.q);
+
+  if (inf.error)
+    {
+      fprintf (stderr, "%s: %s: %s\n", program_name, "read error",
+               inf.error);
+      return -1;
+    }
+  return 0;
+}
+
+#else
+
+int
+decompress_run (struct processor *p, const struct config *cfg, int fd)
+{
+  fprintf (stderr, "%s: --pipeline isn't supported on this system.\n",
+           program_name);
+  return -1;
+}
+
+#endif /* HAVE_DECOMPRESS */
@@ -0,0 +1,47 @@
+/* decompress.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Compressed input, and reading on a thread of its own.
+
+    A file compressed with gzip (or zstd, where libzstd is available)
+    is recognized by its first few bytes, and decompressed as it's
+    read. The decompression is done by a thread of its own, which
+    hands blocks of its output to the decoder through a blockq, so the
+    two work at the same time. With --pipeline, input that isn't
+    compressed is read by the same thread, straight into the blocks.
+*/
+
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include "teseq.h"
+
+#include "blockq.h"
+
+#ifdef HAVE_BLOCKQ
+#  define HAVE_DECOMPRESS       1
+#endif
+
+int decompress_detect (int fd);
+int decompress_run (struct processor *, const struct config *, int fd);
+
+#endif
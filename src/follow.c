@@ -0,0 +1,314 @@
+/* follow.c: following a growing file, for -f. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* For strndup and O_CLOEXEC. */
+#define _GNU_SOURCE
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#  include <sys/inotify.h>
+#endif
+
+#include "follow.h"
+
+extern const char *program_name;
+
+/* How much of the file is read at a time. */
+#define READ_SIZE       65536
+
+/* Without inotify, how long to wait before looking again. */
+#define POLL_SECS       1
+
+struct follower
+{
+  const char *path;
+  int fd;
+  int first_fd;                 /* The one we were given. */
+  struct stat st;               /* What fd was opened as. */
+  unsigned char *buf;
+  int ifd;                      /* The inotify instance, or -1. */
+  int wd;                       /* The watch on the file. */
+};
+
+static volatile sig_atomic_t stopping;
+
+static void
+catch_stop (int s)
+{
+  (void) s;
+  stopping = 1;
+}
+
+static void
+read_error (const char *path)
+{
+  fprintf (stderr, "%s: %s: %s\n", program_name, path, strerror (errno));
+}
+
+/* Feed P everything there is left to read of F's file. Returns 0 at
+   its end, or -1 (having said why) on an error. */
+static int
+drain (struct processor *p, struct follower *f)
+{
+  for (;;)
+    {
+      ssize_t n = read (f->fd, f->buf, READ_SIZE);
+      if (n == -1 && errno == EINTR && !stopping)
+        continue;
+      if (n == -1 && errno == EINTR)
+        return 0;
+      if (n == -1)
+        {
+          read_error (f->path);
+          return -1;
+        }
+      if (n == 0)
+        return 0;
+      processor_feed (p, f->buf, n);
+    }
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/* Watch F's file for changes, and the directory it's in for another
+   file turning up with its name. */
+static void
+watch (struct follower *f)
+{
+  const char *slash = strrchr (f->path, '/');
+
+  f->ifd = inotify_init1 (IN_CLOEXEC);
+  if (f->ifd == -1)
+    return;
+  f->wd = inotify_add_watch (f->ifd, f->path,
+                             IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF
+                             | IN_DELETE_SELF);
+  if (slash == NULL)
+    inotify_add_watch (f->ifd, ".", IN_CREATE | IN_MOVED_TO);
+  else if (slash == f->path)
+    inotify_add_watch (f->ifd, "/", IN_CREATE | IN_MOVED_TO);
+  else
+    {
+      char *dir = strndup (f->path, slash - f->path);
+      if (dir)
+        inotify_add_watch (f->ifd, dir, IN_CREATE | IN_MOVED_TO);
+      free (dir);
+    }
+}
+
+/* Move the watch on F's file to the one now at its path. */
+static void
+rewatch (struct follower *f)
+{
+  if (f->ifd == -1)
+    return;
+  if (f->wd != -1)
+    inotify_rm_watch (f->ifd, f->wd);
+  f->wd = inotify_add_watch (f->ifd, f->path,
+                             IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF
+                             | IN_DELETE_SELF);
+}
+#else
+static void
+watch (struct follower *f)
+{
+  f->ifd = -1;
+}
+
+static void
+rewatch (struct follower *f)
+{
+  (void) f;
+}
+#endif
+
+/* Wait for something to happen to F's file, with the signal mask
+   set to MASK for the wait. The stopping signals are blocked the
+   rest of the time, so that one that comes just before the wait
+   still ends it. The events themselves don't matter: the file is
+   looked at afresh each time. */
+static void
+wait_for_change (struct follower *f, const sigset_t *mask)
+{
+  struct timespec ts;
+
+#ifdef HAVE_SYS_INOTIFY_H
+  if (f->ifd != -1)
+    {
+      char events[4096];
+      fd_set fds;
+
+      FD_ZERO (&fds);
+      FD_SET (f->ifd, &fds);
+      if (pselect (f->ifd + 1, &fds, NULL, NULL, NULL, mask) == -1)
+        {
+          if (errno == EINTR)
+            return;
+        }
+      else if (read (f->ifd, events, sizeof events) != -1)
+        return;
+      /* Something's wrong with inotify; fall back on looking. */
+      close (f->ifd);
+      f->ifd = -1;
+    }
+#else
+  (void) f;
+#endif
+  ts.tv_sec = POLL_SECS;
+  ts.tv_nsec = 0;
+  pselect (0, NULL, NULL, NULL, &ts, mask);
+}
+
+/* Check whether F's file has been truncated, or another has taken its
+   place, and start over with P if so. Returns 0, or -1 (having said
+   why) on an error. */
+static int
+check_file (struct processor *p, struct follower *f)
+{
+  struct stat st;
+  off_t pos = lseek (f->fd, 0, SEEK_CUR);
+  int fd;
+
+  if (stat (f->path, &st) == 0
+      && (st.st_dev != f->st.st_dev || st.st_ino != f->st.st_ino))
+    {
+      /* Replaced: finish reading the old file, before the new. */
+      if (drain (p, f) != 0)
+        return -1;
+      fd = open (f->path, O_RDONLY | O_CLOEXEC);
+      if (fd == -1 || fstat (fd, &st) != 0)
+        {
+          /* Gone again already; keep to the old one for now. */
+          if (fd != -1)
+            close (fd);
+          return 0;
+        }
+      fprintf (stderr, "%s: %s has been replaced; following the new"
+               " file.\n", program_name, f->path);
+      if (f->fd != f->first_fd)
+        close (f->fd);
+      f->fd = fd;
+      f->st = st;
+      rewatch (f);
+      processor_restart (p);
+      return 0;
+    }
+  if (fstat (f->fd, &st) == 0 && pos != -1 && st.st_size < pos)
+    {
+      fprintf (stderr, "%s: %s: file truncated.\n", program_name,
+               f->path);
+      if (lseek (f->fd, 0, SEEK_SET) == -1)
+        {
+          read_error (f->path);
+          return -1;
+        }
+      processor_restart (p);
+    }
+  return 0;
+}
+
+/* Decode the file at PATH, already open as FD, into P, writing to
+   OUTF, and keep decoding what's added to it until interrupted.
+   Returns 0 then, or -1 (having said why) on an error. The end of the
+   input is passed on to P either way. */
+int
+follow_run (struct processor *p, const char *path, int fd, FILE *outf)
+{
+  struct follower f;
+  struct sigaction sa;
+  sigset_t stops, mask;
+  int ret = 0;
+
+  f.path = path;
+  f.fd = f.first_fd = fd;
+  f.buf = malloc (READ_SIZE);
+  if (!f.buf)
+    {
+      fprintf (stderr, "%s: Out of memory.\n", program_name);
+      return -1;
+    }
+  if (fstat (fd, &f.st) != 0)
+    {
+      read_error (path);
+      free (f.buf);
+      return -1;
+    }
+
+  /* Interrupting the wait ends following, but not the output. The
+     signals are only let in while waiting; see wait_for_change. */
+  sigemptyset (&stops);
+  sigaddset (&stops, SIGINT);
+  sigaddset (&stops, SIGTERM);
+  sigaddset (&stops, SIGHUP);
+  sigprocmask (SIG_BLOCK, &stops, &mask);
+  sigemptyset (&sa.sa_mask);
+  sa.sa_handler = catch_stop;
+  sa.sa_flags = 0;
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGTERM, &sa, NULL);
+  sigaction (SIGHUP, &sa, NULL);
+
+  /* Watch before reading, so that nothing written in between is
+     missed. */
+  f.wd = -1;
+  watch (&f);
+  while (!stopping)
+    {
+      if (drain (p, &f) != 0)
+        {
+          ret = -1;
+          break;
+        }
+      if (fflush (outf) != 0)
+        {
+          fprintf (stderr, "%s: %s: %s\n", program_name, "write error",
+                   strerror (errno));
+          ret = -1;
+          break;
+        }
+      if (stopping)
+        break;
+      wait_for_change (&f, &mask);
+      if (!stopping && check_file (p, &f) != 0)
+        {
+          ret = -1;
+          break;
+        }
+    }
+  sigprocmask (SIG_SETMASK, &mask, NULL);
+  processor_feed (p, NULL, 0);
+#ifdef HAVE_SYS_INOTIFY_H
+  if (f.ifd != -1)
+    close (f.ifd);
+#endif
+  if (f.fd != fd)
+    close (f.fd);
+  free (f.buf);
+  return ret;
+}
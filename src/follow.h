@@ -0,0 +1,50 @@
+/* follow.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+    Following a growing file.
+
+    With -f, teseq doesn't stop at the end of its input file, but waits
+    for more to be written to it, as tail -f does, and decodes it as it
+    arrives, a block at a time; an escape sequence that isn't all there
+    yet is kept until the rest of it is. Where the system has inotify,
+    teseq sleeps until the file (or the directory it's in) changes;
+    elsewhere, it looks again every second.
+
+    If the file is truncated, it's read again from the start. If it's
+    replaced by another of the same name, as when a log is rotated,
+    the rest of the old one is read, its last line is finished off, and
+    the new one is followed from its start. Following ends with an
+    interrupt (or SIGTERM or SIGHUP), which finishes off the output as
+    at the end of any other input.
+*/
+
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include "teseq.h"
+
+#include <stdio.h>
+
+int follow_run (struct processor *, const char *path, int fd, FILE *outf);
+
+#endif
@@ -0,0 +1,567 @@
+/* index.c: full-text index of decoded sessions. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    File format:
+
+        "teseq-index 1\n"
+        number of lines
+        for each line:
+            offset, minus the previous line's offset (zigzag)
+            time in milliseconds, minus the previous line's (zigzag)
+        number of terms
+        for each term, in increasing (bytewise) order:
+            length of term, term
+            number of lines the term occurs in
+            length in bytes of the line numbers that follow
+            for each line: line number plus one, minus the previous
+                line number plus one (or zero, for the first)
+
+    Every number is written as an unsigned variable-length integer:
+    seven bits per byte, least significant first, with the high bit
+    set on every byte but the last. Signed values are "zigzag"-encoded
+    first (0, -1, 1, -2... become 0, 1, 2, 3...).
+*/
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "index.h"
+
+#define INDEX_MAGIC     "teseq-index 1\n"
+
+/* Characters, besides whitespace and controls, that separate terms. */
+#define TERM_SEPARATORS "\"'`()<>[]{},;|&="
+
+struct bytes
+{
+  unsigned char *buf;
+  size_t len;
+  size_t size;
+};
+
+struct term
+{
+  char *text;
+  size_t len;
+  uintmax_t n_lines;
+  uintmax_t last_line;          /* Line number plus one, or zero. */
+  struct bytes lines;
+};
+
+struct index
+{
+  struct term **slots;          /* Open-addressed hash table. */
+  size_t n_slots;
+  size_t n_terms;
+  uintmax_t n_lines;
+  struct bytes line_table;
+  intmax_t prev_offset;
+  intmax_t prev_time;
+};
+
+static int
+bytes_put_varint (struct bytes *b, uintmax_t n)
+{
+  if (b->size - b->len < 10)
+    {
+      size_t size = b->size ? 2 * b->size : 16;
+      unsigned char *buf = realloc (b->buf, size);
+      if (!buf)
+        return -1;
+      b->buf = buf;
+      b->size = size;
+    }
+  while (n >= 0x80)
+    {
+      b->buf[b->len++] = (n & 0x7f) | 0x80;
+      n >>= 7;
+    }
+  b->buf[b->len++] = n;
+  return 0;
+}
+
+static uintmax_t
+zigzag (intmax_t n)
+{
+  return n < 0 ? ((uintmax_t) -(n + 1) << 1) | 1 : (uintmax_t) n << 1;
+}
+
+static intmax_t
+unzigzag (uintmax_t n)
+{
+  return n & 1 ? -(intmax_t) (n >> 1) - 1 : (intmax_t) (n >> 1);
+}
+
+static int
+is_separator (unsigned char c)
+{
+  return c <= 0x20 || c == 0x7f || strchr (TERM_SEPARATORS, c) != NULL;
+}
+
+/* Find the next term in the text from *P to END, copying it (folded
+   to lower case, and truncated to INDEX_TERM_MAX) into TERM. Returns
+   the term's length, or zero if there are no more terms. */
+static size_t
+next_term (const char **p, const char *end, char *term)
+{
+  const char *s = *p;
+  size_t len = 0;
+
+  while (s != end && is_separator (*s))
+    ++s;
+  for (; s != end && !is_separator (*s); ++s)
+    if (len != INDEX_TERM_MAX)
+      {
+        unsigned char c = *s;
+        term[len++] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+      }
+  *p = s;
+  return len;
+}
+
+/* FNV-1a. */
+static size_t
+hash_term (const char *text, size_t len)
+{
+  uint32_t h = 2166136261u;
+  size_t i;
+
+  for (i = 0; i != len; ++i)
+    {
+      h ^= (unsigned char) text[i];
+      h *= 16777619u;
+    }
+  return h;
+}
+
+struct index *
+index_new (void)
+{
+  struct index *idx = calloc (1, sizeof *idx);
+
+  if (!idx)
+    return NULL;
+  idx->n_slots = 1024;
+  idx->slots = calloc (idx->n_slots, sizeof *idx->slots);
+  if (!idx->slots)
+    {
+      free (idx);
+      return NULL;
+    }
+  return idx;
+}
+
+void
+index_delete (struct index *idx)
+{
+  size_t i;
+
+  for (i = 0; i != idx->n_slots; ++i)
+    if (idx->slots[i])
+      {
+        free (idx->slots[i]->text);
+        free (idx->slots[i]->lines.buf);
+        free (idx->slots[i]);
+      }
+  free (idx->slots);
+  free (idx->line_table.buf);
+  free (idx);
+}
+
+/* Double the size of the hash table. */
+static int
+grow (struct index *idx)
+{
+  size_t n_slots = 2 * idx->n_slots;
+  struct term **slots = calloc (n_slots, sizeof *slots);
+  size_t i;
+
+  if (!slots)
+    return -1;
+  for (i = 0; i != idx->n_slots; ++i)
+    {
+      struct term *t = idx->slots[i];
+      size_t j;
+
+      if (!t)
+        continue;
+      for (j = hash_term (t->text, t->len) & (n_slots - 1); slots[j];
+           j = (j + 1) & (n_slots - 1))
+        ;
+      slots[j] = t;
+    }
+  free (idx->slots);
+  idx->slots = slots;
+  idx->n_slots = n_slots;
+  return 0;
+}
+
+static struct term *
+find_term (struct index *idx, const char *text, size_t len)
+{
+  size_t mask = idx->n_slots - 1;
+  size_t i;
+  struct term *t;
+
+  for (i = hash_term (text, len) & mask; (t = idx->slots[i]);
+       i = (i + 1) & mask)
+    if (t->len == len && memcmp (t->text, text, len) == 0)
+      return t;
+
+  /* Keep the table at most half full. */
+  if (2 * (idx->n_terms + 1) > idx->n_slots)
+    {
+      if (grow (idx) != 0)
+        return NULL;
+      return find_term (idx, text, len);
+    }
+  t = calloc (1, sizeof *t);
+  if (!t)
+    return NULL;
+  t->text = malloc (len);
+  if (!t->text)
+    {
+      free (t);
+      return NULL;
+    }
+  memcpy (t->text, text, len);
+  t->len = len;
+  idx->slots[i] = t;
+  ++idx->n_terms;
+  return t;
+}
+
+/* Add the line of text TEXT (LEN bytes long), which appeared at input
+   offset OFFSET and time TIME. Returns 0 on success, or -1 if memory
+   ran out. */
+int
+index_add_line (struct index *idx, const char *text, size_t len,
+                off_t offset, double time)
+{
+  const char *end = text + len;
+  char term[INDEX_TERM_MAX];
+  intmax_t ms = (intmax_t) (time * 1000.0 + 0.5);
+  uintmax_t line = ++idx->n_lines;
+  size_t tlen;
+
+  if (bytes_put_varint (&idx->line_table,
+                        zigzag ((intmax_t) offset - idx->prev_offset)) != 0
+      || bytes_put_varint (&idx->line_table,
+                           zigzag (ms - idx->prev_time)) != 0)
+    return -1;
+  idx->prev_offset = offset;
+  idx->prev_time = ms;
+
+  while ((tlen = next_term (&text, end, term)) != 0)
+    {
+      struct term *t = find_term (idx, term, tlen);
+
+      if (!t)
+        return -1;
+      if (t->last_line == line)
+        continue;
+      if (bytes_put_varint (&t->lines, line - t->last_line) != 0)
+        return -1;
+      t->last_line = line;
+      ++t->n_lines;
+    }
+  return 0;
+}
+
+static int
+compare_terms (const void *va, const void *vb)
+{
+  const struct term *a = *(struct term * const *) va;
+  const struct term *b = *(struct term * const *) vb;
+  int r = memcmp (a->text, b->text, a->len < b->len ? a->len : b->len);
+
+  if (r != 0)
+    return r;
+  return a->len < b->len ? -1 : a->len > b->len;
+}
+
+static int
+write_varint (FILE *f, uintmax_t n)
+{
+  while (n >= 0x80)
+    {
+      if (putc ((n & 0x7f) | 0x80, f) == EOF)
+        return -1;
+      n >>= 7;
+    }
+  return putc (n, f) == EOF ? -1 : 0;
+}
+
+/* Write the index to F. Returns 0 on success, or -1 on error (errno
+   is set). */
+int
+index_write (struct index *idx, FILE *f)
+{
+  struct term **terms = malloc ((idx->n_terms + 1) * sizeof *terms);
+  size_t i, n = 0;
+  int ret = -1;
+
+  if (!terms)
+    return -1;
+  for (i = 0; i != idx->n_slots; ++i)
+    if (idx->slots[i])
+      terms[n++] = idx->slots[i];
+  qsort (terms, n, sizeof *terms, compare_terms);
+
+  if (fputs (INDEX_MAGIC, f) == EOF
+      || write_varint (f, idx->n_lines) != 0
+      || fwrite (idx->line_table.buf, 1, idx->line_table.len, f)
+         != idx->line_table.len
+      || write_varint (f, n) != 0)
+    goto done;
+  for (i = 0; i != n; ++i)
+    {
+      struct term *t = terms[i];
+      if (write_varint (f, t->len) != 0
+          || fwrite (t->text, 1, t->len, f) != t->len
+          || write_varint (f, t->n_lines) != 0
+          || write_varint (f, t->lines.len) != 0
+          || fwrite (t->lines.buf, 1, t->lines.len, f) != t->lines.len)
+        goto done;
+    }
+  ret = 0;
+
+done:
+  free (terms);
+  return ret;
+}
+
+struct index_reader
+{
+  unsigned char *buf;
+  size_t size;
+  uintmax_t n_lines;
+  intmax_t *offsets;
+  intmax_t *times;              /* In milliseconds. */
+  const unsigned char *terms;   /* Start of the term list. */
+  uintmax_t n_terms;
+};
+
+static int
+read_varint (const unsigned char **p, const unsigned char *end,
+             uintmax_t *n)
+{
+  uintmax_t v = 0;
+  unsigned int shift = 0;
+
+  for (;;)
+    {
+      if (*p == end || shift >= 64)
+        return -1;
+      v |= (uintmax_t) (**p & 0x7f) << shift;
+      shift += 7;
+      if (!(*(*p)++ & 0x80))
+        break;
+    }
+  *n = v;
+  return 0;
+}
+
+void
+index_reader_delete (struct index_reader *r)
+{
+  free (r->buf);
+  free (r->offsets);
+  free (r->times);
+  free (r);
+}
+
+/* Load an index from F. Returns NULL on error: errno is set if it was
+   a read error or memory ran out, or zero if F isn't a valid index. */
+struct index_reader *
+index_read (FILE *f)
+{
+  struct index_reader *r = calloc (1, sizeof *r);
+  size_t alloc = 0;
+  const unsigned char *p, *end;
+  uintmax_t i, n;
+  intmax_t offset = 0, time = 0;
+
+  if (!r)
+    return NULL;
+  for (;;)
+    {
+      size_t got;
+      if (r->size == alloc)
+        {
+          unsigned char *buf;
+          alloc = alloc ? 2 * alloc : 65536;
+          buf = realloc (r->buf, alloc);
+          if (!buf)
+            goto fail;
+          r->buf = buf;
+        }
+      got = fread (r->buf + r->size, 1, alloc - r->size, f);
+      r->size += got;
+      if (got == 0)
+        break;
+    }
+  if (ferror (f))
+    goto fail;
+
+  errno = 0;
+  p = r->buf;
+  end = r->buf + r->size;
+  if (r->size < sizeof INDEX_MAGIC - 1
+      || memcmp (p, INDEX_MAGIC, sizeof INDEX_MAGIC - 1) != 0)
+    goto fail;
+  p += sizeof INDEX_MAGIC - 1;
+  /* Each line takes at least two bytes. */
+  if (read_varint (&p, end, &r->n_lines) != 0
+      || r->n_lines > (uintmax_t) (end - p) / 2)
+    goto fail;
+  r->offsets = malloc ((r->n_lines + 1) * sizeof *r->offsets);
+  r->times = malloc ((r->n_lines + 1) * sizeof *r->times);
+  if (!r->offsets || !r->times)
+    goto fail;
+  for (i = 0; i != r->n_lines; ++i)
+    {
+      if (read_varint (&p, end, &n) != 0)
+        goto fail;
+      offset += unzigzag (n);
+      if (read_varint (&p, end, &n) != 0)
+        goto fail;
+      time += unzigzag (n);
+      r->offsets[i] = offset;
+      r->times[i] = time;
+    }
+  if (read_varint (&p, end, &r->n_terms) != 0)
+    goto fail;
+  r->terms = p;
+  return r;
+
+fail:
+  index_reader_delete (r);
+  return NULL;
+}
+
+/* Find the list of lines for TERM. On success, *LINES and *N_LINES
+   are set to the encoded line numbers and their count (zero if the
+   term isn't in the index); returns -1 if the index is corrupt. */
+static int
+lookup (struct index_reader *r, const char *term, size_t len,
+        const unsigned char **lines, uintmax_t *n_lines)
+{
+  const unsigned char *p = r->terms;
+  const unsigned char *end = r->buf + r->size;
+  uintmax_t i, tlen, n, size;
+
+  *n_lines = 0;
+  for (i = 0; i != r->n_terms; ++i)
+    {
+      int cmp;
+
+      if (read_varint (&p, end, &tlen) != 0 || tlen > (uintmax_t) (end - p))
+        return -1;
+      cmp = memcmp (p, term, tlen < len ? tlen : len);
+      if (cmp == 0)
+        cmp = tlen < len ? -1 : tlen > len;
+      p += tlen;
+      if (read_varint (&p, end, &n) != 0
+          || read_varint (&p, end, &size) != 0
+          || size > (uintmax_t) (end - p))
+        return -1;
+      if (cmp == 0)
+        {
+          *lines = p;
+          *n_lines = n;
+          return 0;
+        }
+      if (cmp > 0)
+        break;
+      p += size;
+    }
+  return 0;
+}
+
+/* Call FN for each line that contains all of the terms in QUERY.
+   Returns 0 on success, or -1 if memory ran out (errno is set) or
+   the index is corrupt (errno is zero). */
+int
+index_search (struct index_reader *r, const char *query, index_hit_fn fn,
+              void *arg)
+{
+  const char *q = query;
+  const char *qend = query + strlen (query);
+  char term[INDEX_TERM_MAX];
+  uintmax_t *hits = NULL;
+  uintmax_t n_hits = 0;
+  int first = 1;
+  size_t len;
+  uintmax_t i;
+
+  while ((len = next_term (&q, qend, term)) != 0)
+    {
+      const unsigned char *p;
+      const unsigned char *end = r->buf + r->size;
+      uintmax_t n, j, k = 0, line = 0;
+
+      errno = 0;
+      if (lookup (r, term, len, &p, &n) != 0)
+        goto fail;
+      if (first)
+        {
+          hits = malloc ((n + 1) * sizeof *hits);
+          if (!hits)
+            goto fail;
+        }
+      /* Keep only those hits that are also in this term's list. Both
+         lists are in increasing order. */
+      for (j = 0, i = 0; j != n && (first || i != n_hits); ++j)
+        {
+          uintmax_t delta;
+          if (read_varint (&p, end, &delta) != 0)
+            goto fail;
+          line += delta;
+          if (line == 0 || line > r->n_lines)
+            goto fail;
+          if (first)
+            hits[k++] = line - 1;
+          else
+            {
+              while (i != n_hits && hits[i] < line - 1)
+                ++i;
+              if (i != n_hits && hits[i] == line - 1)
+                hits[k++] = hits[i++];
+            }
+        }
+      n_hits = k;
+      first = 0;
+    }
+  for (i = 0; i != n_hits; ++i)
+    fn (r->offsets[hits[i]], r->times[hits[i]] / 1000.0, arg);
+  free (hits);
+  return 0;
+
+fail:
+  free (hits);
+  return -1;
+}
@@ -0,0 +1,65 @@
+/* index.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Full-text index.
+
+    Lines of text are added to an index along with the input offset
+    and time at which they appeared. index_write then writes out an
+    inverted index: a table of the lines' offsets and times, followed
+    by the sorted list of terms, each with the numbers of the lines it
+    occurs in. Both tables are delta-encoded, as variable-length
+    integers.
+
+    An index written this way can be loaded with index_read, and
+    searched with index_search.
+*/
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "teseq.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/* Terms longer than this are truncated. */
+#define INDEX_TERM_MAX  64
+
+struct index;
+
+struct index *index_new (void);
+void index_delete (struct index *);
+int index_add_line (struct index *, const char *, size_t, off_t, double);
+int index_write (struct index *, FILE *);
+
+/* An index_hit_fn gets the input offset and time of a line that
+   matched, and the arg passed to index_search. */
+typedef void (*index_hit_fn)(off_t, double, void *);
+
+struct index_reader;
+
+struct index_reader *index_read (FILE *);
+void index_reader_delete (struct index_reader *);
+int index_search (struct index_reader *, const char *, index_hit_fn, void *);
+
+#endif
@@ -24,57 +24,82 @@
 #include <errno.h>
 #include <stdlib.h>
 
+#include "arena.h"
 #include "inputbuf.h"
 #include "ringbuf.h"
 
 struct inputbuf
 {
-  FILE *file;
+  struct arena *arena;          /* Where this came from, or NULL. */
+  FILE *file;                   /* NULL in push mode. */
+  const unsigned char *chunk;   /* Pushed input not yet read. */
+  size_t chunklen;
+  int ended;                    /* The end of the pushed input. */
   int saving;
   size_t count;
   size_t saved_count;
+  off_t offset;                 /* Characters consumed before the
+                                   last count reset. */
   struct ringbuf *rb;
   struct ringbuf_reader *reader;
+  size_t max;                   /* How far rb may grow, */
+  int grown;                    /* and whether it has. */
   int err;
 };
 
 struct inputbuf *
 inputbuf_new (FILE * f, size_t bufsz)
+{
+  return inputbuf_new_in (NULL, f, bufsz);
+}
+
+/* Make an inputbuf, and its buffer, from ARENA (or with malloc, if
+   it's NULL). */
+struct inputbuf *
+inputbuf_new_in (struct arena *arena, FILE * f, size_t bufsz)
 {
   struct inputbuf *ret = NULL;
   struct ringbuf *rb = NULL;
   struct ringbuf_reader *reader = NULL;
 
-  ret = malloc (sizeof *ret);
+  ret = arena_alloc (arena, sizeof *ret);
   if (!ret)
     goto cleanup;
-  rb = ringbuf_new (bufsz);
+  rb = ringbuf_new_in (arena, bufsz);
   if (!rb)
     goto cleanup;
   reader = ringbuf_reader_new (rb);
   if (!reader)
     goto cleanup;
 
+  ret->arena = arena;
   ret->rb = rb;
   ret->reader = reader;
   ret->file = f;
+  ret->chunk = NULL;
+  ret->chunklen = 0;
+  ret->ended = 0;
   ret->saving = 0;
   ret->count = 0;
+  ret->offset = 0;
+  ret->max = bufsz;
+  ret->grown = 0;
   ret->err = 0;
   return ret;
 
 cleanup:
-  free (ret);
-  free (rb);
-  free (reader);
+  if (rb)
+    ringbuf_delete (rb);
+  arena_free (arena, ret);
   return NULL;
 }
 
 void
 inputbuf_delete (struct inputbuf *ib)
 {
+  ringbuf_reader_delete (ib->reader);
   ringbuf_delete (ib->rb);
-  free (ib);
+  arena_free (ib->arena, ib);
 }
 
 int
@@ -83,6 +108,49 @@ inputbuf_io_error (struct inputbuf *ib)
   return ib->err;
 }
 
+/* Let the buffer grow, when more needs to be kept, to as much as MAX
+   characters. It goes back to its first size once emptied again. */
+void
+inputbuf_set_max (struct inputbuf *ib, size_t max)
+{
+  ib->max = max;
+}
+
+/* Make room in the buffer for NEED more characters, growing it if
+   it's allowed to. Returns nonzero if there isn't room. */
+static int
+make_room (struct inputbuf *ib, size_t need)
+{
+  size_t size = ringbuf_size (ib->rb);
+  size_t want = ringbuf_count (ib->rb) + need;
+
+  if (want <= size)
+    return 0;
+  if (want > ib->max)
+    return 1;
+  while (size < want)
+    size *= 2;
+  if (size > ib->max)
+    size = ib->max;
+  if (ringbuf_grow (ib->rb, size))
+    return 1;
+  ib->grown = 1;
+  return 0;
+}
+
+/* The next character from the input file, or from the pushed
+   input. */
+static int
+next_char (struct inputbuf *ib)
+{
+  if (ib->file)
+    return getc_unlocked (ib->file);
+  if (ib->chunklen == 0)
+    return EOF;
+  --ib->chunklen;
+  return *ib->chunk++;
+}
+
 int
 inputbuf_get (struct inputbuf *ib)
 {
@@ -90,10 +158,11 @@ inputbuf_get (struct inputbuf *ib)
   if (ib->saving)
     {
       c = ringbuf_reader_get (ib->reader);
-      if (c == EOF && ringbuf_space_avail (ib->rb))
+      if (c == EOF && (ringbuf_space_avail (ib->rb)
+                       || make_room (ib, 1) == 0))
         {
           errno = 0;
-          c = getc (ib->file);
+          c = next_char (ib);
           if (c == EOF)
             ib->err = errno;
           else
@@ -105,10 +174,15 @@ inputbuf_get (struct inputbuf *ib)
   else
     {
       c = ringbuf_get (ib->rb);
+      if (c == EOF && ib->grown)
+        {
+          ringbuf_shrink (ib->rb);
+          ib->grown = 0;
+        }
       if (c == EOF)
         {
           errno = 0;
-          c = getc (ib->file);
+          c = next_char (ib);
         }
       if (c == EOF)
         ib->err = errno;
@@ -154,9 +228,18 @@ inputbuf_get_count (struct inputbuf *ib)
   return ib->count;
 }
 
+/* Total number of characters consumed (not counting any that are
+   only being looked ahead at) since the input buffer was created.  */
+off_t
+inputbuf_get_offset (struct inputbuf *ib)
+{
+  return ib->offset + ib->count;
+}
+
 void
 inputbuf_reset_count (struct inputbuf *ib)
 {
+  ib->offset += ib->count;
   ib->count = 0;
   ib->saved_count = 0;
 }
@@ -168,3 +251,108 @@ inputbuf_avail (struct inputbuf *ib)
     : !ringbuf_is_empty (ib->rb);
 }
 
+/* Push mode (an inputbuf made without a file): make the LEN bytes at
+   BUF the next input. They are read in place, so must stay put until
+   they have been read, or kept with inputbuf_hold. A LEN of zero
+   marks the end of the input; pushing more after that starts a new
+   one. */
+void
+inputbuf_push (struct inputbuf *ib, const unsigned char *buf, size_t len)
+{
+  ib->chunk = buf;
+  ib->chunklen = len;
+  ib->ended = len == 0;
+}
+
+/* Whether the end of the input has been pushed. */
+int
+inputbuf_ended (struct inputbuf *ib)
+{
+  return ib->ended;
+}
+
+/* Return the character N places ahead of the next one to be read
+   (when not saving), without reading it; or EOF if it hasn't been
+   pushed yet. */
+int
+inputbuf_peek (struct inputbuf *ib, size_t n)
+{
+  size_t held = ringbuf_count (ib->rb);
+
+  if (n < held)
+    return ringbuf_peek (ib->rb, n);
+  n -= held;
+  return n < ib->chunklen ? ib->chunk[n] : EOF;
+}
+
+/* Point *SPAN at the characters from N places ahead of the next one
+   to be read (when not saving), as many as are together in memory,
+   and return how many that is; or zero if there aren't any yet. A
+   scan of what's ahead goes a span at a time, rather than a peek at
+   a time. */
+size_t
+inputbuf_span (struct inputbuf *ib, size_t n, const unsigned char **span)
+{
+  struct ringbuf_span sp[2];
+  int i, count = ringbuf_read_spans (ib->rb, sp);
+
+  for (i = 0; i != count; ++i)
+    {
+      if (n < sp[i].len)
+        {
+          *span = sp[i].buf + n;
+          return sp[i].len - n;
+        }
+      n -= sp[i].len;
+    }
+  if (n >= ib->chunklen)
+    return 0;
+  *span = ib->chunk + n;
+  return ib->chunklen - n;
+}
+
+/* Read past the next N characters (when not saving), which
+   inputbuf_span has shown are there, all at once. */
+void
+inputbuf_skip (struct inputbuf *ib, size_t n)
+{
+  size_t held = ringbuf_count (ib->rb);
+
+  ib->count += n;
+  if (n < held)
+    {
+      ringbuf_consume (ib->rb, n);
+      return;
+    }
+  ringbuf_consume (ib->rb, held);
+  if (ib->grown)
+    {
+      ringbuf_shrink (ib->rb);
+      ib->grown = 0;
+    }
+  ib->chunk += n - held;
+  ib->chunklen -= n - held;
+}
+
+/* Put C, the last character read (when not saving), back. */
+int
+inputbuf_unget (struct inputbuf *ib, unsigned char c)
+{
+  if (ringbuf_putback (ib->rb, c)
+      && (make_room (ib, 1) || ringbuf_putback (ib->rb, c)))
+    return 1;
+  --ib->count;
+  return 0;
+}
+
+/* Copy what's left of the pushed input into the buffer, so that the
+   caller can reuse its memory. Returns nonzero if it doesn't fit. */
+int
+inputbuf_hold (struct inputbuf *ib)
+{
+  if (make_room (ib, ib->chunklen)
+      || ringbuf_putmem (ib->rb, (const char *) ib->chunk, ib->chunklen))
+    return 1;
+  ib->chunklen = 0;
+  return 0;
+}
@@ -27,7 +27,17 @@
     begin saving the characters into a buffer. The inputbuf_rewind
     function is used to re-read the saved characters; and
     inputbuf_forget is used to indicate that we are done processing
-    the saved characters, and they should be forgotten.
+    the saved characters, and they should be forgotten. The buffer can
+    be allowed to grow, for a look-ahead longer than it was made for,
+    with inputbuf_set_max.
+
+    An inputbuf made without a stream is in push mode: its input is
+    handed to it, a piece at a time, with inputbuf_push. Reading past
+    what has been pushed gives EOF, so inputbuf_peek can be used to
+    make sure that what is about to be read is all there (or
+    inputbuf_span, to look through it a span at a time, and
+    inputbuf_skip to read it that way too); if it isn't, inputbuf_unget
+    and inputbuf_hold keep the rest for the next push.
 
     See test-inputbuf.cm for usage.
 */
@@ -36,19 +46,32 @@
 #define INPUTBUF_H
 
 #include <stdio.h>
+#include <sys/types.h>
 
+struct arena;
 struct inputbuf;
 
 struct inputbuf *inputbuf_new (FILE *, size_t);
+struct inputbuf *inputbuf_new_in (struct arena *, FILE *, size_t);
 void inputbuf_delete (struct inputbuf *);
 int inputbuf_io_error (struct inputbuf *);
+void inputbuf_set_max (struct inputbuf *, size_t);
 
 int inputbuf_get (struct inputbuf *);
 int inputbuf_saving (struct inputbuf *);
 int inputbuf_rewind (struct inputbuf *);
 int inputbuf_forget (struct inputbuf *);
 size_t inputbuf_get_count (struct inputbuf *);
+off_t inputbuf_get_offset (struct inputbuf *);
 void inputbuf_reset_count (struct inputbuf *);
 int inputbuf_avail (struct inputbuf *);
 
+void inputbuf_push (struct inputbuf *, const unsigned char *, size_t);
+int inputbuf_ended (struct inputbuf *);
+int inputbuf_peek (struct inputbuf *, size_t);
+size_t inputbuf_span (struct inputbuf *, size_t, const unsigned char **);
+void inputbuf_skip (struct inputbuf *, size_t);
+int inputbuf_unget (struct inputbuf *, unsigned char);
+int inputbuf_hold (struct inputbuf *);
+
 #endif
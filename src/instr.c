@@ -0,0 +1,193 @@
+/* instr.c: per-stage counters, for --enable-instrumentation. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* For fopencookie. */
+#define _GNU_SOURCE
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "instr.h"
+
+#ifdef ENABLE_INSTRUMENTATION
+
+struct instr_stat instr_stats[INSTR_N_STAGES];
+volatile sig_atomic_t instr_dump_pending;
+
+static const char *const stage_names[INSTR_N_STAGES] = {
+  "input", "csi", "format", "color", "write"
+};
+
+static void
+catch_usr1 (int s)
+{
+  (void) s;
+  instr_dump_pending = 1;
+}
+
+/* Arrange for SIGUSR1 to request a dump. The wrapped streams restart
+   the system calls it interrupts, dumping first; elsewhere, the
+   pending dump is made by the main loop. */
+void
+instr_setup (void)
+{
+  struct sigaction sa;
+
+  sigemptyset (&sa.sa_mask);
+  sa.sa_handler = catch_usr1;
+#ifdef HAVE_FOPENCOOKIE
+  sa.sa_flags = 0;
+#else
+  sa.sa_flags = SA_RESTART;
+#endif
+  sigaction (SIGUSR1, &sa, NULL);
+}
+
+void
+instr_stop (const struct timespec *start, enum instr_stage stage,
+            size_t bytes)
+{
+  struct timespec now;
+  struct instr_stat *s = &instr_stats[stage];
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  ++s->calls;
+  s->bytes += bytes;
+  s->nsecs += (uintmax_t) (now.tv_sec - start->tv_sec) * 1000000000
+    + now.tv_nsec - start->tv_nsec;
+}
+
+/* Write the counters to F. Returns 0 on success, or -1 on a write
+   error. */
+int
+instr_dump (FILE *f)
+{
+  struct rusage ru;
+  size_t i;
+
+  fprintf (f, "%-8s %16s %20s %14s\n", "stage", "calls", "bytes",
+           "seconds");
+  for (i = 0; i != INSTR_N_STAGES; ++i)
+    fprintf (f, "%-8s %16ju %20ju %14.6f\n", stage_names[i],
+             instr_stats[i].calls, instr_stats[i].bytes,
+             instr_stats[i].nsecs / 1e9);
+  if (getrusage (RUSAGE_SELF, &ru) == 0)
+    fprintf (f, "%-8s %14ld.%06ld\n%-8s %14ld.%06ld\n",
+             "user", (long) ru.ru_utime.tv_sec, (long) ru.ru_utime.tv_usec,
+             "system", (long) ru.ru_stime.tv_sec, (long) ru.ru_stime.tv_usec);
+  fflush (f);
+  return ferror (f) ? -1 : 0;
+}
+
+#ifdef HAVE_FOPENCOOKIE
+/* A wrapped stream reads and writes the file descriptor of the
+   original one directly, timing each system call. */
+
+static void
+check_dump (void)
+{
+  if (instr_dump_pending)
+    {
+      instr_dump_pending = 0;
+      instr_dump (stderr);
+    }
+}
+
+static ssize_t
+cookie_read (void *cookie, char *buf, size_t size)
+{
+  int fd = fileno ((FILE *) cookie);
+  ssize_t n;
+  INSTR_DECL (t);
+
+  for (;;)
+    {
+      INSTR_START (t);
+      n = read (fd, buf, size);
+      INSTR_STOP (t, INSTR_INPUT, n > 0 ? n : 0);
+      if (n != -1 || errno != EINTR)
+        return n;
+      check_dump ();
+    }
+}
+
+static ssize_t
+cookie_write (void *cookie, const char *buf, size_t size)
+{
+  int fd = fileno ((FILE *) cookie);
+  size_t done = 0;
+  INSTR_DECL (t);
+
+  while (done != size)
+    {
+      ssize_t n;
+      INSTR_START (t);
+      n = write (fd, buf + done, size - done);
+      INSTR_STOP (t, INSTR_WRITE, n > 0 ? n : 0);
+      if (n == -1 && errno == EINTR)
+        check_dump ();
+      else if (n == -1)
+        return done ? (ssize_t) done : -1;
+      else
+        done += n;
+    }
+  return done;
+}
+
+static int
+cookie_close (void *cookie)
+{
+  FILE *f = cookie;
+  return (f == stdin || f == stdout) ? 0 : fclose (f);
+}
+
+/* Return a stream that reads or writes the same file as F, but whose
+   system calls are counted. Must be called before F is used. */
+FILE *
+instr_wrap (FILE *f, const char *mode)
+{
+  cookie_io_functions_t funcs = { NULL, NULL, NULL, NULL };
+  FILE *w;
+
+  funcs.read = cookie_read;
+  funcs.write = cookie_write;
+  funcs.close = cookie_close;
+  w = fopencookie (f, mode, funcs);
+  return w ? w : f;
+}
+
+#else
+
+FILE *
+instr_wrap (FILE *f, const char *mode)
+{
+  return f;
+}
+
+#endif /* HAVE_FOPENCOOKIE */
+
+#endif /* ENABLE_INSTRUMENTATION */
@@ -0,0 +1,95 @@
+/* instr.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Instrumentation.
+
+    When teseq is configured with --enable-instrumentation, the time
+    spent in, the number of calls to and the bytes passed through each
+    of the stages below are counted, and written to the standard error
+    on exit, or when SIGUSR1 is received.
+
+    The read and write system calls are timed by wrapping the input and
+    output streams with instr_wrap, where the C library allows it.
+    Other stages are timed with the INSTR_* macros, which expand to
+    nothing otherwise:
+
+        INSTR_DECL (t);         (last of the declarations)
+        ...
+        INSTR_START (t);
+        ...the work...
+        INSTR_STOP (t, INSTR_FORMAT, len);
+
+    Stages can nest (color output happens during formatting, and
+    writes during both), so their times overlap.
+*/
+
+#ifndef INSTR_H
+#define INSTR_H
+
+#include "teseq.h"
+
+enum instr_stage
+{
+  INSTR_INPUT,                  /* read(), for the input. */
+  INSTR_CSI,                    /* read_csi_sequence. */
+  INSTR_FORMAT,                 /* putter_printf. */
+  INSTR_COLOR,                  /* do_color. */
+  INSTR_WRITE,                  /* write(), for the output. */
+  INSTR_N_STAGES
+};
+
+#ifdef ENABLE_INSTRUMENTATION
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+struct instr_stat
+{
+  uintmax_t calls;
+  uintmax_t bytes;
+  uintmax_t nsecs;
+};
+
+extern struct instr_stat instr_stats[INSTR_N_STAGES];
+extern volatile sig_atomic_t instr_dump_pending;
+
+void instr_setup (void);
+FILE *instr_wrap (FILE *, const char *mode);
+void instr_stop (const struct timespec *, enum instr_stage, size_t);
+int instr_dump (FILE *);
+
+#  define INSTR_DECL(t)             struct timespec t
+#  define INSTR_START(t)            clock_gettime (CLOCK_MONOTONIC, &(t))
+#  define INSTR_STOP(t, stage, n)   instr_stop (&(t), (stage), (n))
+
+#else
+
+#  define INSTR_DECL(t)
+#  define INSTR_START(t)            ((void) 0)
+#  define INSTR_STOP(t, stage, n)   ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,190 @@
+/* passthrough.c: copying the input through, for --passthrough. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* For tee. */
+#define _GNU_SOURCE
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "passthrough.h"
+#include "record.h"
+
+extern const char *program_name;
+
+/* The most that is copied at a time. */
+#define PASS_SIZE       65536
+
+#ifdef HAVE_TEE
+static int
+is_pipe (int fd)
+{
+  struct stat st;
+  return fstat (fd, &st) == 0 && S_ISFIFO (st.st_mode);
+}
+#endif
+
+static int
+write_all (int fd, const unsigned char *buf, size_t len)
+{
+  while (len)
+    {
+      ssize_t n = write (fd, buf, len);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1)
+        return -1;
+      buf += n;
+      len -= n;
+    }
+  return 0;
+}
+
+/* Read from FD into BUF until LEN bytes have been read (if ALL is
+   set), or until anything has been. Returns the number of bytes read,
+   0 at the end of the input, or -1 on an error. */
+static ssize_t
+read_some (int fd, unsigned char *buf, size_t len, int all)
+{
+  size_t got = 0;
+
+  while (got < len)
+    {
+      ssize_t n = read (fd, buf + got, len - got);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1)
+        return -1;
+      if (n == 0)
+        break;
+      got += n;
+      if (!all)
+        break;
+    }
+  return got;
+}
+
+/* Write LEN bytes from BUF to OUTFD, and hand them to P. Returns 0 on
+   success, or -1 (having said why) if the write failed. */
+int
+passthrough_copy (struct processor *p, int outfd,
+                  const unsigned char *buf, size_t len)
+{
+  if (write_all (outfd, buf, len) != 0)
+    {
+      fprintf (stderr, "%s: %s: %s\n", program_name, "write error",
+               strerror (errno));
+      return -1;
+    }
+  processor_feed (p, buf, len);
+  return 0;
+}
+
+/* Copy everything from INFD to OUTFD (unless it's -1), and hand the
+   same bytes to P, with the time waited for each read, if CFG asks for
+   --timestamp. The end of the input is passed on to P too, unless CFG
+   asks for a --checkpoint. Returns 0 on success, or -1 (having said why) on an
+   error, which ends the copying. */
+int
+passthrough_run (struct processor *p, const struct config *cfg,
+                 int infd, int outfd)
+{
+  unsigned char *buf = malloc (PASS_SIZE);
+  struct recorder rec;
+  int use_tee = 0;
+  int ret = 0;
+
+  if (!buf)
+    {
+      fprintf (stderr, "%s: Out of memory.\n", program_name);
+      return -1;
+    }
+#ifdef HAVE_TEE
+  use_tee = outfd != -1 && is_pipe (infd) && is_pipe (outfd);
+#endif
+  recorder_start (&rec, cfg);
+  for (;;)
+    {
+      size_t want = PASS_SIZE;
+      double wait;
+      ssize_t n;
+
+#ifdef HAVE_TEE
+      if (use_tee)
+        {
+          n = tee (infd, outfd, PASS_SIZE, 0);
+          if (n == -1 && errno == EINTR)
+            continue;
+          if (n == -1 && errno == EINVAL)
+            {
+              /* Not pipes that tee can use, after all. */
+              use_tee = 0;
+              continue;
+            }
+          if (n == -1)
+            {
+              fprintf (stderr, "%s: %s: %s\n", program_name, "write error",
+                       strerror (errno));
+              ret = -1;
+              break;
+            }
+          if (n == 0)
+            break;
+          want = n;
+        }
+#endif
+      /* What was just copied by tee is still in the input pipe, so
+         read all of it (and no more). */
+      n = read_some (infd, buf, want, use_tee);
+      if (n == -1)
+        {
+          fprintf (stderr, "%s: %s: %s\n", program_name, "read error",
+                   strerror (errno));
+          ret = -1;
+          break;
+        }
+      if (n == 0)
+        break;
+      wait = recorder_read (&rec, buf, n);
+      if (cfg->timestamp)
+        processor_delay (p, wait);
+      if (use_tee || outfd == -1)
+        processor_feed (p, buf, n);
+      else if (passthrough_copy (p, outfd, buf, n) != 0)
+        {
+          ret = -1;
+          break;
+        }
+    }
+  /* With --checkpoint, an escape sequence that isn't all there is
+     left for the next run to read again. */
+  if (!cfg->checkpoint)
+    processor_feed (p, NULL, 0);
+  recorder_end (&rec);
+  free (buf);
+  return ret;
+}
@@ -0,0 +1,48 @@
+/* passthrough.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Passthrough mode.
+
+    With --passthrough, the input is copied to the standard output
+    unchanged, and the description of it goes to a file instead, so
+    that teseq can sit in a pipeline without disturbing it. Where both
+    the input and the standard output are pipes, the bytes are copied
+    between them with tee(2), without passing through teseq's memory;
+    they are then read from the input pipe once, for the decoder.
+    Otherwise, they are read once, and written out from the same
+    buffer that is handed to the decoder.
+
+    The same loop reads the input for --timestamp and --checkpoint,
+    with or without anything to copy it to.
+*/
+
+#ifndef PASSTHROUGH_H
+#define PASSTHROUGH_H
+
+#include "teseq.h"
+
+int passthrough_run (struct processor *, const struct config *,
+                     int infd, int outfd);
+int passthrough_copy (struct processor *, int outfd,
+                      const unsigned char *, size_t);
+
+#endif
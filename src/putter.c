@@ -23,34 +23,61 @@
 
 #include <errno.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
+#include "instr.h"
 #include "putter.h"
 
 #define DEFAULT_LINE_MAX        78
 
 struct putter
 {
+  struct arena *arena;          /* Where this came from, or NULL. */
   FILE *file;
   size_t nc;
   const char *presep;
   size_t presz;
   const char *postsep;
   size_t postsz;
-  size_t linemax;
-  struct sgr_def *sgr;
-  struct sgr_def *sgr_decor;
+  size_t linemax;               /* Zero for no limit. */
+  const struct colors *colors;  /* NULL for no color. */
+  const struct sgr_def *sgr;
+  const struct sgr_def *sgr_decor;
+  char *scratch;                /* Where putter_printf formats. */
+  size_t scratchsz;
+  const struct sgr_def *color_want;   /* Color to write before the next
+                                   output. */
+  const struct sgr_def *color_on;     /* Color in effect (&sgr0 for none, NULL
+                                   if a mix). */
+  int color_reset;              /* A reset was asked for since the last
+                                   color was written. */
 
   putter_error_handler handler;
   void *handler_arg;
 };
 
+static const struct sgr_def sgr0 = { "", 0, NULL, 0 };
+
 struct putter *
-putter_new (FILE * file)
+putter_new (FILE * file, const struct colors *colors)
 {
-  struct putter *p = malloc (sizeof *p);
+  return putter_new_in (NULL, file, colors);
+}
+
+/* Make a putter from ARENA (or with malloc, if it's NULL). */
+struct putter *
+putter_new_in (struct arena *arena, FILE * file,
+               const struct colors *colors)
+{
+  struct putter *p = arena_alloc (arena, sizeof *p);
+  if (!p)
+    return NULL;
+  p->arena = arena;
   p->file = file;
+  p->colors = colors;
   p->nc = 0;
   p->linemax = DEFAULT_LINE_MAX;
   p->presep = p->postsep = "";
@@ -60,6 +87,11 @@ putter_new (FILE * file)
   p->handler_arg = NULL;
   p->sgr = NULL;
   p->sgr_decor = NULL;
+  p->scratch = NULL;
+  p->scratchsz = 0;
+  p->color_want = NULL;
+  p->color_on = &sgr0;
+  p->color_reset = 0;
   return p;
 }
 
@@ -83,24 +115,101 @@ putter_new (FILE * file)
 #define BRACED(p) \
   ((p)->presep != NULL && (p)->presep[0] != '\0')
 
-static struct sgr_def sgr0 = { "", 0 };
-
+/* Colors are not written as soon as they're asked for, but just
+   before the next thing that is written: so a color that's already
+   in effect needn't be written again, and a reset followed directly
+   by a color can be written as one sequence. */
 static void
-do_color (struct putter *p, struct sgr_def *sgr)
+do_color (struct putter *p, const struct sgr_def *sgr)
 {
-  int e;
-
-  if (configuration.color != CFG_COLOR_ALWAYS || sgr == NULL)
+  if (p->colors == NULL || sgr == NULL)
     return;
 
+  p->color_want = sgr;
+  if (sgr == &sgr0)
+    p->color_reset = 1;
+}
+
+static void
+write_color (struct putter *p, const char *seq, size_t len)
+{
+  size_t e;
+
   HANDLE_ERROR
     (
       p,
-      e = fprintf (p->file, "\033[%.*sm", sgr->len, sgr->sgr),
-      e < 0
+      e = fwrite (seq, 1, len, p->file),
+      e != len
     );
 }
 
+/* Write out the color change that's pending, if any. */
+static void
+apply_color (struct putter *p)
+{
+  const struct sgr_def *sgr = p->color_want;
+  INSTR_DECL (t);
+
+  if (sgr == NULL)
+    return;
+  INSTR_START (t);
+  if (sgr == &sgr0)
+    {
+      if (p->color_on != &sgr0)
+        write_color (p, "\033[m", 3);
+      p->color_on = &sgr0;
+    }
+  else if (sgr != p->color_on)
+    {
+      int reset = p->color_reset && p->color_on != &sgr0;
+      if (sgr->seq == NULL)
+        {
+          int e;
+          HANDLE_ERROR
+            (
+              p,
+              e = fprintf (p->file, "\033[%s%.*sm", reset ? "0;" : "",
+                           sgr->len, sgr->sgr),
+              e < 0
+            );
+        }
+      else if (reset)
+        write_color (p, sgr->seq + sgr->seqlen + 1, sgr->seqlen + 2);
+      else
+        write_color (p, sgr->seq, sgr->seqlen);
+      /* Without a reset first, what's in effect is a mix of the two. */
+      p->color_on = (reset || p->color_on == &sgr0) ? sgr : NULL;
+    }
+  p->color_want = NULL;
+  p->color_reset = 0;
+  INSTR_STOP (t, INSTR_COLOR, 0);
+}
+
+/* Write to the file, after any pending color change. */
+#define PUT(p, action, cond)                    \
+  do                                            \
+    {                                           \
+      apply_color (p);                          \
+      HANDLE_ERROR (p, action, cond);           \
+    }                                           \
+  while (0)
+
+/* Build the escape sequences for SGR: "\033[<sgr>m", followed by
+   "\033[0;<sgr>m" (for use after a reset). If there's no memory for
+   them, apply_color formats them each time instead. */
+void
+putter_cache_sgr (struct sgr_def *sgr)
+{
+  free (sgr->seq);
+  sgr->seqlen = sgr->len + 3;
+  /* Each sequence, and the null byte after it; the one after a reset
+     is two longer. */
+  sgr->seq = malloc (2 * sgr->seqlen + 4);
+  if (sgr->seq)
+    sprintf (sgr->seq, "\033[%.*sm%c\033[0;%.*sm", sgr->len, sgr->sgr, 0,
+             sgr->len, sgr->sgr);
+}
+
 
 void
 putter_set_handler (struct putter *p, putter_error_handler f, void *arg)
@@ -110,15 +219,30 @@ putter_set_handler (struct putter *p, putter_error_handler f, void *arg)
 }
 
 
+/* Split lines that would be longer than WIDTH columns; or, if it's
+   zero, never split them. */
+void
+putter_set_width (struct putter *p, size_t width)
+{
+  p->linemax = width;
+}
+
 void
 putter_delete (struct putter *p)
 {
-  free (p);
+  arena_free (p->arena, p->scratch);
+  arena_free (p->arena, p);
 }
 
 static void
 ensure_space (struct putter *p, size_t addition)
 {
+  /* With no limit, there's only the column to keep track of. */
+  if (p->linemax == 0)
+    {
+      p->nc += addition;
+      return;
+    }
   errno = 0;
   if (p->nc + addition > p->linemax || p->nc + p->presz == p->linemax)
     {
@@ -127,7 +251,7 @@ ensure_space (struct putter *p, size_t addition)
         {
           do_color (p, &sgr0);
           do_color (p, p->sgr_decor);
-          HANDLE_ERROR
+          PUT
             (
               p,
               cs = fprintf (p->file, "%s\n%s", p->presep, p->postsep),
@@ -140,14 +264,14 @@ ensure_space (struct putter *p, size_t addition)
       else 
         {
           do_color (p, &sgr0);
-          HANDLE_ERROR
+          PUT
             (
               p,
               cs = fputc ('\n', p->file),
               cs == EOF
             );
           do_color(p, p->sgr);
-          HANDLE_ERROR
+          PUT
             (
               p,
               cs = fputs (p->postsep, p->file),
@@ -160,8 +284,8 @@ ensure_space (struct putter *p, size_t addition)
 }
 
 void
-putter_start (struct putter *p, struct sgr_def *sgr,
-              struct sgr_def *sgr_decor, /* Only used for text decorations. */
+putter_start (struct putter *p, const struct sgr_def *sgr,
+              const struct sgr_def *sgr_decor, /* Only used for text decorations. */
               const char *s, const char *pre, const char *post)
 {
   int e;
@@ -178,7 +302,7 @@ putter_start (struct putter *p, struct sgr_def *sgr,
 
   if (p->nc > 0)
     {
-      HANDLE_ERROR
+      PUT
         (
           p,
           e = putc ('\n', p->file),
@@ -191,7 +315,7 @@ putter_start (struct putter *p, struct sgr_def *sgr,
     do_color (p, p->sgr_decor);
   else
     do_color (p, p->sgr);
-  HANDLE_ERROR
+  PUT
     (
       p,
       e = fputs (s, p->file),
@@ -205,6 +329,33 @@ putter_start (struct putter *p, struct sgr_def *sgr,
     }
 }
 
+/* Pick up a line that was left unfinished at column NC (by another
+   putter, with --checkpoint), as though putter_start had begun it
+   with the same arguments. Nothing is written. */
+void
+putter_resume (struct putter *p, const struct sgr_def *sgr,
+               const struct sgr_def *sgr_decor,
+               const char *pre, const char *post, size_t nc)
+{
+  p->presep = pre;
+  p->postsep = post;
+  p->presz = strlen (pre);
+  p->postsz = strlen (post);
+  p->sgr = sgr;
+  p->sgr_decor = sgr_decor;
+  if (p->sgr_decor && p->sgr_decor->len == 0)
+    p->sgr_decor = NULL;
+  p->nc = nc;
+}
+
+/* The column the line being written has got to; zero if there isn't
+   one. */
+size_t
+putter_column (const struct putter *p)
+{
+  return p->nc;
+}
+
 void
 putter_finish (struct putter *p, const char *s)
 {
@@ -217,7 +368,7 @@ putter_finish (struct putter *p, const char *s)
   do_color (p, &sgr0);
   if (BRACED (p))
     do_color (p, p->sgr_decor);
-  HANDLE_ERROR
+  PUT
     (
       p,
       cs = fprintf (p->file, "%s", s),
@@ -225,7 +376,7 @@ putter_finish (struct putter *p, const char *s)
     );
   if (BRACED (p) && p->sgr_decor)
     do_color (p, &sgr0);
-  HANDLE_ERROR
+  PUT
     (
       p,
       cs = fputc ('\n', p->file),
@@ -246,7 +397,7 @@ putter_putc (struct putter *p, unsigned char c)
   int e;
 
   ensure_space (p, 1);
-  HANDLE_ERROR
+  PUT
     (
       p,
       e = putc (c, p->file),
@@ -257,35 +408,105 @@ putter_putc (struct putter *p, unsigned char c)
 void
 putter_puts (struct putter *p, const char *s)
 {
-  int e;
-  
-  ensure_space (p, strlen (s));
-  HANDLE_ERROR
+  putter_putn (p, s, strlen (s));
+}
+
+/* Like putter_puts, for the first LEN bytes of S. */
+void
+putter_putn (struct putter *p, const char *s, size_t len)
+{
+  size_t e;
+
+  ensure_space (p, len);
+  PUT
     (
       p,
-      e = fputs (s, p->file),
-      e == EOF
+      e = fwrite (s, 1, len, p->file),
+      e != len
     );
 }
 
+/* Put PFX followed by N in decimal, as a single unit. */
+void
+putter_put_uint (struct putter *p, const char *pfx, uintmax_t n)
+{
+  char buf[64];
+  char *d = buf + sizeof buf;
+  size_t pfxsz = strlen (pfx);
+
+  do
+    *--d = '0' + n % 10;
+  while ((n /= 10) != 0);
+  d -= pfxsz;
+  memcpy (d, pfx, pfxsz);
+  putter_putn (p, d, buf + sizeof buf - d);
+}
+
+/* Put PFX followed by C as two uppercase hexadecimal digits. */
+void
+putter_put_hex (struct putter *p, const char *pfx, unsigned char c)
+{
+  static const char digits[] = "0123456789ABCDEF";
+  char buf[32];
+  size_t pfxsz = strlen (pfx);
+
+  memcpy (buf, pfx, pfxsz);
+  buf[pfxsz] = digits[c >> 4];
+  buf[pfxsz + 1] = digits[c & 0xf];
+  putter_putn (p, buf, pfxsz + 2);
+}
+
+/* Formats into the scratch buffer (growing it if need be), so that
+   the length for ensure_space and the output come from one pass. */
 void
 putter_printf (struct putter *p, const char *fmt, ...)
 {
   int len, ret, serr;
   va_list ap;
+  INSTR_DECL (t);
 
+  INSTR_START (t);
   va_start (ap, fmt);
-  len = vsnprintf (NULL, 0, fmt, ap);
+  len = vsnprintf (p->scratch, p->scratchsz, fmt, ap);
   va_end (ap);
-  ensure_space (p, len);
-  va_start (ap, fmt);
-  errno = 0;
-  ret = vfprintf (p->file, fmt, ap);
-  serr = errno;
-  va_end (ap);
-  errno = serr;
-  HANDLER_IF (p, ret < 0);
-  return;
+  if (len >= 0 && (size_t) len >= p->scratchsz)
+    {
+      size_t sz = p->scratchsz ? p->scratchsz : 64;
+      char *b;
+
+      while (sz <= (size_t) len)
+        sz *= 2;
+      /* Not realloc, since it may be in an arena; the old contents
+         aren't needed anyway. */
+      b = arena_alloc (p->arena, sz);
+      if (b)
+        {
+          arena_free (p->arena, p->scratch);
+          p->scratch = b;
+          p->scratchsz = sz;
+          va_start (ap, fmt);
+          len = vsnprintf (p->scratch, p->scratchsz, fmt, ap);
+          va_end (ap);
+        }
+      else
+        {
+          /* No room to format into; write it out directly. */
+          ensure_space (p, len);
+          apply_color (p);
+          va_start (ap, fmt);
+          errno = 0;
+          ret = vfprintf (p->file, fmt, ap);
+          serr = errno;
+          va_end (ap);
+          errno = serr;
+          HANDLER_IF (p, ret < 0);
+          INSTR_STOP (t, INSTR_FORMAT, len);
+          return;
+        }
+    }
+  if (len > 0)
+    putter_putn (p, p->scratch, len);
+  INSTR_STOP (t, INSTR_FORMAT, len > 0 ? len : 0);
 }
 
 /* Combines:
@@ -293,7 +514,7 @@ putter_printf (struct putter *p, const char *fmt, ...)
  *      putter_printf (p, fmt, ...);
  *      putter_finish (p, ""); */
 static void
-vsingle (struct putter *p, struct sgr_def *sgr,
+vsingle (struct putter *p, const struct sgr_def *sgr,
          const char *pfx, const char *fmt, va_list ap)
 {
   int e;
@@ -301,7 +522,7 @@ vsingle (struct putter *p, struct sgr_def *sgr,
   if (p->nc > 0)
     {
       do_color (p, &sgr0);
-      HANDLE_ERROR
+      PUT
         (
           p,
           e = putc ('\n', p->file),
@@ -310,9 +531,10 @@ vsingle (struct putter *p, struct sgr_def *sgr,
     }
 
   do_color (p, sgr);
+  apply_color (p);
   fputs (pfx, p->file);
 
-  HANDLE_ERROR
+  PUT
     (
       p,
       e = vfprintf (p->file, fmt, ap),
@@ -329,7 +551,7 @@ vsingle (struct putter *p, struct sgr_def *sgr,
 
   do_color (p, &sgr0);
 
-  HANDLE_ERROR
+  PUT
     (
       p,
       e = putc ('\n', p->file),
@@ -343,7 +565,7 @@ vsingle (struct putter *p, struct sgr_def *sgr,
   { \
     va_list ap; \
     va_start (ap, fmt); \
-    vsingle (p, &sgr_ ## name, (pfx), fmt, ap); \
+    vsingle (p, p->colors ? &p->colors->name : NULL, (pfx), fmt, ap); \
     va_end (ap); \
   }
 
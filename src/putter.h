@@ -31,22 +31,35 @@
 
 #include "teseq.h"
 
+#include <stdint.h>
 #include <stdio.h>
 
+struct arena;
 struct putter;
 
 /* A putter_error_handler gets the current value of errno, and the
    arg passed to putter_set_handler. */
 typedef void (*putter_error_handler)(int, void *);
 
-struct putter *putter_new (FILE *);
+struct putter *putter_new (FILE *, const struct colors *);
+struct putter *putter_new_in (struct arena *, FILE *, const struct colors *);
 void putter_set_handler (struct putter *, putter_error_handler, void *);
+void putter_set_width (struct putter *, size_t);
 void putter_delete (struct putter *);
-void putter_start (struct putter *, struct sgr_def *, struct sgr_def *,
+void putter_cache_sgr (struct sgr_def *);
+void putter_start (struct putter *, const struct sgr_def *,
+                   const struct sgr_def *,
                    const char *, const char *, const char *);
+void putter_resume (struct putter *, const struct sgr_def *,
+                    const struct sgr_def *, const char *, const char *,
+                    size_t);
+size_t putter_column (const struct putter *);
 void putter_finish (struct putter *, const char *);
 void putter_putc (struct putter *, unsigned char);
 void putter_puts (struct putter *, const char *);
+void putter_putn (struct putter *, const char *, size_t);
+void putter_put_uint (struct putter *, const char *, uintmax_t);
+void putter_put_hex (struct putter *, const char *, unsigned char);
 void putter_printf (struct putter *, const char *, ...);
 
 void putter_single_esc   (struct putter *, const char *, ...);
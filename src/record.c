@@ -0,0 +1,80 @@
+/* record.c: timing live input, and recording it for -t. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "teseq.h"
+
+#include <stdio.h>
+
+#include "record.h"
+
+/* Start timing input for CFG, and begin its typescript, if it has
+   one. */
+void
+recorder_start (struct recorder *r, const struct config *cfg)
+{
+  r->cfg = cfg;
+  r->wait = 0.0;
+  if (cfg->record)
+    {
+      time_t t = time (NULL);
+      fprintf (cfg->record, "Script started on %s", ctime (&t));
+    }
+  clock_gettime (CLOCK_MONOTONIC, &r->last);
+}
+
+/* Note that LEN bytes have just been read into BUF. Returns how long
+   was waited for them, since the last read (or the start).
+
+   The timings are written as script writes them: it takes the time
+   before each read, so the wait for each piece of input is given on
+   the line for the piece after it (which is how -t reads them). */
+double
+recorder_read (struct recorder *r, const unsigned char *buf, size_t len)
+{
+  const struct config *cfg = r->cfg;
+  struct timespec now;
+  double wait;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  wait = (now.tv_sec - r->last.tv_sec)
+    + (now.tv_nsec - r->last.tv_nsec) / 1e9;
+  r->last = now;
+  if (cfg->record_timings)
+    fprintf (cfg->record_timings, "%f %lu\n", r->wait, (unsigned long) len);
+  if (cfg->record)
+    fwrite (buf, 1, len, cfg->record);
+  r->wait = wait;
+  return wait;
+}
+
+/* Finish the typescript and timings files, if there are any. */
+void
+recorder_end (struct recorder *r)
+{
+  const struct config *cfg = r->cfg;
+  time_t t = time (NULL);
+
+  /* The wait for the last piece has no piece after it to go with. */
+  if (cfg->record_timings && r->wait != 0.0)
+    fprintf (cfg->record_timings, "%f 0\n", r->wait);
+  if (cfg->record)
+    fprintf (cfg->record, "\nScript done on %s", ctime (&t));
+}
@@ -0,0 +1,51 @@
+/* record.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Timing live input.
+
+    When teseq reads its input straight from a file descriptor (with
+    --command or --timestamp), the time at which each read returns is
+    taken, once per read rather than per byte. The wait before each
+    read can be shown as a delay line, and the input and its timings
+    can be written out (--record and --record-timings) in the forms
+    script -t writes, for replaying with -t.
+*/
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "teseq.h"
+
+#include <time.h>
+
+struct recorder
+{
+  const struct config *cfg;
+  struct timespec last;         /* When the last read returned. */
+  double wait;                  /* How long was waited for it. */
+};
+
+void recorder_start (struct recorder *, const struct config *);
+double recorder_read (struct recorder *, const unsigned char *, size_t);
+void recorder_end (struct recorder *);
+
+#endif
@@ -25,51 +25,54 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "ringbuf.h"
 
-#define ADVANCE_CURSOR(rb, c) \
-        do { \
-                ++(c); \
-                if ((c) == (rb)->buf + (rb)->size) \
-                        (c) = (rb)->buf; \
-        } while (0)
-
-#define BACKUP_CURSOR(rb, c) \
-        do { \
-                if ((c) == (rb)->buf) \
-                        (c) += ((rb)->size - 1u); \
-                else \
-                        --(c); \
-        } while (0)
-
+/* The buffer's storage is rounded up to a power of two, so that a
+   position in it is just an index, masked. START and END count the
+   characters taken out and put in, and wrap around freely; SIZE is
+   still the most the buffer will hold. A buffer that has grown keeps
+   its contents in storage of its own, until it shrinks back. */
 struct ringbuf
 {
+  struct arena *arena;          /* Where this came from, or NULL. */
   size_t size;
+  size_t mask;                  /* The storage's size, less one. */
   unsigned char *buf;
-  unsigned char *start;
-  unsigned char *end;
-  int full;
+  size_t start;
+  size_t end;
+  size_t first_size;            /* As first made, with the storage */
+  size_t first_mask;            /* following the ringbuf. */
 };
 
 struct ringbuf *
 ringbuf_new (size_t bufsz)
 {
-  unsigned char *buf = malloc (bufsz);
+  return ringbuf_new_in (NULL, bufsz);
+}
+
+/* Make a ringbuf of BUFSZ bytes from ARENA (or with malloc, if it's
+   NULL). The buffer follows the ringbuf itself. */
+struct ringbuf *
+ringbuf_new_in (struct arena *arena, size_t bufsz)
+{
   struct ringbuf *newbuf;
-  if (!buf)
-    return NULL;
-  newbuf = malloc (sizeof *newbuf);
+  size_t cap = 1;
+
+  while (cap < bufsz)
+    cap <<= 1;
+  newbuf = arena_alloc (arena, sizeof *newbuf + cap);
   if (!newbuf)
-    {
-      free (buf);
-      return NULL;
-    }
+    return NULL;
 
+  newbuf->arena = arena;
   newbuf->size = bufsz;
-  newbuf->buf = buf;
-  newbuf->start = buf;
-  newbuf->end = buf;
-  newbuf->full = 0;
+  newbuf->mask = cap - 1;
+  newbuf->buf = (unsigned char *) (newbuf + 1);
+  newbuf->start = 0;
+  newbuf->end = 0;
+  newbuf->first_size = bufsz;
+  newbuf->first_mask = cap - 1;
 
   return newbuf;
 }
@@ -77,110 +80,230 @@ ringbuf_new (size_t bufsz)
 void
 ringbuf_delete (struct ringbuf *rb)
 {
-  free (rb->buf);
-  free (rb);
+  if (rb->buf != (unsigned char *) (rb + 1))
+    free (rb->buf);
+  arena_free (rb->arena, rb);
 }
 
 int
 ringbuf_is_empty (struct ringbuf *rb)
 {
-  return rb->start == rb->end && !rb->full;
+  return rb->start == rb->end;
 }
 
 int
 ringbuf_put (struct ringbuf *rb, unsigned char c)
 {
-  if (rb->full)
+  if (rb->end - rb->start == rb->size)
     return 1;
-  *rb->end++ = c;
-  if (rb->end == rb->buf + rb->size)
-    rb->end = rb->buf;
-  if (rb->start == rb->end)
-    rb->full = 1;
+  rb->buf[rb->end++ & rb->mask] = c;
   return 0;
 }
 
 int
 ringbuf_putback (struct ringbuf *rb, unsigned char c)
 {
-  if (rb->full)
+  if (rb->end - rb->start == rb->size)
     return 1;
-  BACKUP_CURSOR (rb, rb->start);
-  *rb->start = c;
+  rb->buf[--rb->start & rb->mask] = c;
   return 0;
 }
 
 size_t
 ringbuf_space_avail (struct ringbuf * rb)
 {
-  if (rb->full)
-    return 0u;
-  if (rb->end >= rb->start)
-    return (((rb->buf + rb->size) - rb->end) + (rb->start - rb->buf));
-  return rb->start - rb->end;
+  return rb->size - (rb->end - rb->start);
+}
+
+/* Number of characters in the buffer. */
+size_t
+ringbuf_count (struct ringbuf *rb)
+{
+  return rb->end - rb->start;
+}
+
+/* Return the character N places from the start of the buffer,
+   without removing it; or EOF if there aren't that many. */
+int
+ringbuf_peek (struct ringbuf *rb, size_t n)
+{
+  if (n >= ringbuf_count (rb))
+    return EOF;
+  return rb->buf[(rb->start + n) & rb->mask];
+}
+
+/* Fill in SPANS with the storage from FROM to TO, in order, and
+   return how many it takes: none if they're the same, and two if it
+   wraps around. */
+static int
+spans (struct ringbuf *rb, size_t from, size_t to,
+       struct ringbuf_span spans[2])
+{
+  size_t i = from & rb->mask;
+  size_t len = to - from;
+
+  if (len == 0)
+    return 0;
+  spans[0].buf = rb->buf + i;
+  if (len <= rb->mask + 1 - i)
+    {
+      spans[0].len = len;
+      return 1;
+    }
+  spans[0].len = rb->mask + 1 - i;
+  spans[1].buf = rb->buf;
+  spans[1].len = len - spans[0].len;
+  return 2;
+}
+
+/* The characters in the buffer, as (up to) two spans, in order.
+   Returns the number of spans. */
+int
+ringbuf_read_spans (struct ringbuf *rb, struct ringbuf_span sp[2])
+{
+  return spans (rb, rb->start, rb->end, sp);
+}
+
+/* Remove the first N characters from the buffer (which must hold
+   that many). */
+void
+ringbuf_consume (struct ringbuf *rb, size_t n)
+{
+  rb->start += n;
+}
+
+/* The space left in the buffer, as (up to) two spans, in order, for
+   filling. Returns the number of spans. */
+int
+ringbuf_write_spans (struct ringbuf *rb, struct ringbuf_span sp[2])
+{
+  return spans (rb, rb->end, rb->start + rb->size, sp);
+}
+
+/* Add to the buffer the first N characters of the space given by
+   ringbuf_write_spans, once they've been filled in. */
+void
+ringbuf_commit (struct ringbuf *rb, size_t n)
+{
+  rb->end += n;
+}
+
+/* Move the contents into the storage at BUF, of MASK + 1 bytes, at
+   the same positions (masked), so that readers keep their places. */
+static void
+move_to (struct ringbuf *rb, unsigned char *buf, size_t mask)
+{
+  struct ringbuf_span sp[2];
+  size_t pos = rb->start;
+  int n, i;
+
+  n = ringbuf_read_spans (rb, sp);
+  for (i = 0; i != n; ++i)
+    {
+      size_t at = pos & mask;
+      size_t snip = mask + 1 - at;
+
+      if (snip > sp[i].len)
+        snip = sp[i].len;
+      memcpy (buf + at, sp[i].buf, snip);
+      memcpy (buf, sp[i].buf + snip, sp[i].len - snip);
+      pos += sp[i].len;
+    }
+  if (rb->buf != (unsigned char *) (rb + 1))
+    free (rb->buf);
+  rb->buf = buf;
+  rb->mask = mask;
+}
+
+/* Let the buffer hold up to SIZE characters (more than it does now).
+   Returns nonzero if there isn't the memory for it. */
+int
+ringbuf_grow (struct ringbuf *rb, size_t size)
+{
+  size_t cap = rb->mask + 1;
+
+  if (size > cap)
+    {
+      unsigned char *buf;
+
+      while (cap < size)
+        cap <<= 1;
+      buf = malloc (cap);
+      if (!buf)
+        return 1;
+      move_to (rb, buf, cap - 1);
+    }
+  rb->size = size;
+  return 0;
+}
+
+/* Go back to the size the buffer was made with, if it has grown and
+   what it holds fits. */
+void
+ringbuf_shrink (struct ringbuf *rb)
+{
+  if (rb->size == rb->first_size
+      || ringbuf_count (rb) > rb->first_size)
+    return;
+  if (rb->mask != rb->first_mask)
+    move_to (rb, (unsigned char *) (rb + 1), rb->first_mask);
+  rb->size = rb->first_size;
+}
+
+/* The most the buffer holds, for now. */
+size_t
+ringbuf_size (struct ringbuf *rb)
+{
+  return rb->size;
 }
 
 int
 ringbuf_putmem (struct ringbuf *rb, const char *mem, size_t memsz)
 {
-  if (rb->full)
-    return 1;
+  struct ringbuf_span sp[2];
+  int n, i;
+
   if (ringbuf_space_avail (rb) < memsz)
     return 1;
-  if (rb->end >= rb->start)
+  n = ringbuf_write_spans (rb, sp);
+  for (i = 0; i != n && memsz != 0; ++i)
     {
-      size_t snip = rb->buf + rb->size - rb->end;
-      if (snip > memsz)
-        snip = memsz;
-      memcpy (rb->end, mem, snip);
-      memsz -= snip;
-      rb->end += snip;
-      if (rb->end == rb->buf + rb->size)
-        rb->end = rb->buf;
-      if (memsz == 0)
-        return 0;
+      size_t snip = sp[i].len < memsz ? sp[i].len : memsz;
+      memcpy (sp[i].buf, mem, snip);
+      ringbuf_commit (rb, snip);
       mem += snip;
+      memsz -= snip;
     }
-  memcpy (rb->end, mem, memsz);
-  rb->end += memsz;
-  if (rb->end == rb->start)
-    rb->full = 1;
   return 0;
 }
 
 int
 ringbuf_get (struct ringbuf *rb)
 {
-  int ret;
   if (ringbuf_is_empty (rb))
     return EOF;
-  rb->full = 0;
-  ret = *rb->start;
-  ADVANCE_CURSOR (rb, rb->start);
-  if (rb->start == rb->buf + rb->size)
-    rb->start = rb->buf;
-  return ret;
+  return rb->buf[rb->start++ & rb->mask];
 }
 
 void
 ringbuf_clear (struct ringbuf *rb)
 {
   rb->start = rb->end;
-  rb->full = 0;
 }
-
+
 
 /* buffer iterator. */
 struct ringbuf_reader
 {
   struct ringbuf *rb;
-  unsigned char *cursor;
+  size_t cursor;
+  int at_end;                   /* Stays at the end, as more is put. */
 };
 
 struct ringbuf_reader *
 ringbuf_reader_new (struct ringbuf *rb)
 {
-  struct ringbuf_reader *reader = malloc (sizeof *reader);
+  struct ringbuf_reader *reader = arena_alloc (rb->arena, sizeof *reader);
   if (!reader)
     return NULL;
   reader->rb = rb;
@@ -191,54 +314,56 @@ ringbuf_reader_new (struct ringbuf *rb)
 void
 ringbuf_reader_delete (struct ringbuf_reader *reader)
 {
-  free (reader);
+  arena_free (reader->rb->arena, reader);
 }
 
 void
 ringbuf_reader_reset (struct ringbuf_reader *reader)
 {
-  if (ringbuf_is_empty (reader->rb))
-    reader->cursor = NULL;
-  else
-    reader->cursor = reader->rb->start;
+  reader->cursor = reader->rb->start;
+  reader->at_end = ringbuf_is_empty (reader->rb);
 }
 
 void
 ringbuf_reader_to_end (struct ringbuf_reader *reader)
 {
-  reader->cursor = NULL;
+  reader->at_end = 1;
 }
 
 int
 ringbuf_reader_at_end (struct ringbuf_reader *reader)
 {
-  return reader->cursor == NULL;
+  return reader->at_end;
 }
 
 int
 ringbuf_reader_get (struct ringbuf_reader *reader)
 {
+  struct ringbuf *rb = reader->rb;
   int ret;
-  if (reader->cursor == NULL)
+
+  if (reader->at_end)
     return EOF;
-  ret = *reader->cursor;
-  ADVANCE_CURSOR (reader->rb, reader->cursor);
-  if (reader->cursor == reader->rb->end)
-    reader->cursor = NULL;
+  ret = rb->buf[reader->cursor++ & rb->mask];
+  if (reader->cursor == rb->end)
+    reader->at_end = 1;
   return ret;
 }
 
+/* The characters from the reader's place to the end of the buffer,
+   as (up to) two spans, in order, without moving it. Returns the
+   number of spans. */
+int
+ringbuf_reader_spans (struct ringbuf_reader *reader,
+                      struct ringbuf_span sp[2])
+{
+  if (reader->at_end)
+    return 0;
+  return spans (reader->rb, reader->cursor, reader->rb->end, sp);
+}
+
 void
 ringbuf_reader_consume (struct ringbuf_reader *reader)
 {
-  if (reader->cursor == NULL)
-    {
-      reader->rb->start = reader->rb->end;
-      reader->rb->full = 0;
-    }
-  else if (reader->cursor != reader->rb->start)
-    {
-      reader->rb->start = reader->cursor;
-      reader->rb->full = 0;
-    }
+  reader->rb->start = reader->at_end ? reader->rb->end : reader->cursor;
 }
@@ -19,22 +19,46 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-/* See test-ringbuf.cm for usage. */
+/* See test-ringbuf.cm for usage.
+
+   Besides a character at a time, the contents (or the space left) can
+   be had as the spans of memory that hold them: one, or two where they
+   wrap around the end of the storage.
+
+   A buffer can be grown, to hold more, and shrunk back to the size it
+   was made with once it's emptied out again. */
 
 #ifndef RINGBUF_H
 #define RINGBUF_H
 
+struct arena;
 struct ringbuf;
 
+struct ringbuf_span
+{
+  unsigned char *buf;
+  size_t len;
+};
+
 struct ringbuf *ringbuf_new (size_t);
+struct ringbuf *ringbuf_new_in (struct arena *, size_t);
 void ringbuf_delete (struct ringbuf *);
+int ringbuf_grow (struct ringbuf *, size_t);
+void ringbuf_shrink (struct ringbuf *);
+size_t ringbuf_size (struct ringbuf *);
 int ringbuf_is_empty (struct ringbuf *rb);
 size_t ringbuf_space_avail (struct ringbuf *rb);
+size_t ringbuf_count (struct ringbuf *rb);
+int ringbuf_peek (struct ringbuf *rb, size_t n);
 int ringbuf_putmem (struct ringbuf *rb, const char *mem, size_t memsz);
 int ringbuf_put (struct ringbuf *, unsigned char);
 int ringbuf_putback (struct ringbuf *, unsigned char);
 int ringbuf_get (struct ringbuf *);
 void ringbuf_clear (struct ringbuf *);
+int ringbuf_read_spans (struct ringbuf *, struct ringbuf_span[2]);
+void ringbuf_consume (struct ringbuf *, size_t);
+int ringbuf_write_spans (struct ringbuf *, struct ringbuf_span[2]);
+void ringbuf_commit (struct ringbuf *, size_t);
 
 /* buffer iterator. */
 struct ringbuf_reader;
@@ -45,6 +69,7 @@ void ringbuf_reader_reset (struct ringbuf_reader *);
 void ringbuf_reader_to_end (struct ringbuf_reader *);
 int ringbuf_reader_at_end (struct ringbuf_reader *);
 int ringbuf_reader_get (struct ringbuf_reader *);
+int ringbuf_reader_spans (struct ringbuf_reader *, struct ringbuf_span[2]);
 void ringbuf_reader_consume (struct ringbuf_reader *);
 
 #endif
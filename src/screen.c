@@ -0,0 +1,1176 @@
+/* screen.c: a simple model of the terminal display. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "screen.h"
+
+/* Cell attributes are packed into 32 bits: a 9-bit foreground color
+   (0-255, or ATTR_COLOR_DEFAULT), a 9-bit background color, and the
+   rendition flags. */
+#define ATTR_COLOR_DEFAULT      256u
+#define ATTR_FG_SHIFT           0
+#define ATTR_BG_SHIFT           9
+#define ATTR_COLOR_MASK         0x1ffu
+#define ATTR_FG(a)              (((a) >> ATTR_FG_SHIFT) & ATTR_COLOR_MASK)
+#define ATTR_BG(a)              (((a) >> ATTR_BG_SHIFT) & ATTR_COLOR_MASK)
+#define ATTR_SET_FG(a, c)       (((a) & ~(ATTR_COLOR_MASK << ATTR_FG_SHIFT)) \
+                                 | ((uint32_t)(c) << ATTR_FG_SHIFT))
+#define ATTR_SET_BG(a, c)       (((a) & ~(ATTR_COLOR_MASK << ATTR_BG_SHIFT)) \
+                                 | ((uint32_t)(c) << ATTR_BG_SHIFT))
+
+#define ATTR_BOLD               (1u << 18)
+#define ATTR_DIM                (1u << 19)
+#define ATTR_ITALIC             (1u << 20)
+#define ATTR_UNDERLINE          (1u << 21)
+#define ATTR_BLINK              (1u << 22)
+#define ATTR_INVERSE            (1u << 23)
+#define ATTR_HIDDEN             (1u << 24)
+#define ATTR_STRIKE             (1u << 25)
+
+#define ATTR_DEFAULT            ((ATTR_COLOR_DEFAULT << ATTR_FG_SHIFT) \
+                                 | (ATTR_COLOR_DEFAULT << ATTR_BG_SHIFT))
+
+#define BLANK_CHAR              0x20
+#define REPLACEMENT_CHAR        0xfffd
+#define TAB_WIDTH               8
+
+/* ANSI mode numbers (see modes.h). */
+#define MODE_IRM                4
+
+struct cell
+{
+  uint32_t ch;
+  uint32_t attr;
+};
+
+struct line
+{
+  struct cell *cells;
+  int wrapped;          /* Text ran off the end of this line
+                           onto the next. */
+  int fresh;            /* Nothing written since it was cleared. */
+  off_t offset;         /* Clock when something was first written. */
+  double time;
+};
+
+struct cursor
+{
+  size_t x;
+  size_t y;
+  uint32_t attr;
+  int origin;
+};
+
+struct screen
+{
+  FILE *file;
+  size_t cols;
+  size_t rows;
+
+  /* Display lines, by row. Scrolling rotates these pointers, rather
+     than moving cell contents. */
+  struct line **lines;
+  struct line **alt_lines;      /* The inactive (primary or alternate)
+                                   screen buffer. */
+  struct line **spare;          /* Scratch space for rotations. */
+  struct line *line_store;
+  struct cell *cell_store;
+  int on_alt;
+
+  /* Change tracking. Each modified row is stamped with the current
+     epoch; a reader of the screen remembers the epoch it last read
+     at, and the epoch is then advanced, so that a row has changed for
+     that reader iff its stamp is greater. */
+  unsigned long epoch;
+  unsigned long *stamp;         /* Per row. */
+  unsigned long last_change;
+  unsigned long dumped;         /* Epoch of the last screen_dump. */
+
+  struct cursor cur;
+  struct cursor saved;
+  int wrap_pending;
+  size_t top, bot;              /* Scrolling region. */
+  int insert;
+  int autowrap;
+  uint32_t last_ch;
+
+  uint32_t utf8_ch;
+  int utf8_need;
+
+  char *outbuf;
+
+  screen_history_fn history;    /* See screen_set_history. */
+  void *history_arg;
+  char *hist;                   /* Text of the history line being
+                                   built. */
+  size_t hist_len;
+  size_t hist_size;
+  off_t hist_offset;
+  double hist_time;
+
+  off_t clock_offset;           /* See screen_set_clock. */
+  double clock_time;
+
+  screen_error_handler handler;
+  void *handler_arg;
+};
+
+static void
+mark_dirty (struct screen *s, size_t row)
+{
+  s->stamp[row] = s->last_change = s->epoch;
+}
+
+static void
+mark_all_dirty (struct screen *s)
+{
+  size_t row;
+
+  for (row = 0; row != s->rows; ++row)
+    s->stamp[row] = s->epoch;
+  s->last_change = s->epoch;
+}
+
+static void
+clear_cells (struct cell *c, size_t n, uint32_t attr)
+{
+  struct cell *ce = c + n;
+  for (; c != ce; ++c)
+    {
+      c->ch = BLANK_CHAR;
+      c->attr = attr;
+    }
+}
+
+static void
+clear_line (struct screen *s, struct line *l)
+{
+  clear_cells (l->cells, s->cols, ATTR_SET_FG (s->cur.attr,
+                                               ATTR_COLOR_DEFAULT));
+  l->wrapped = 0;
+  l->fresh = 1;
+}
+
+static char *
+put_utf8 (char *out, uint32_t ch)
+{
+  if (ch < 0x80)
+    *out++ = ch;
+  else if (ch < 0x800)
+    {
+      *out++ = 0xc0 | (ch >> 6);
+      *out++ = 0x80 | (ch & 0x3f);
+    }
+  else if (ch < 0x10000)
+    {
+      *out++ = 0xe0 | (ch >> 12);
+      *out++ = 0x80 | ((ch >> 6) & 0x3f);
+      *out++ = 0x80 | (ch & 0x3f);
+    }
+  else
+    {
+      *out++ = 0xf0 | ((ch >> 18) & 0x07);
+      *out++ = 0x80 | ((ch >> 12) & 0x3f);
+      *out++ = 0x80 | ((ch >> 6) & 0x3f);
+      *out++ = 0x80 | (ch & 0x3f);
+    }
+  return out;
+}
+
+/* Pass the history line that's been built on to the history
+   function. */
+static void
+end_history_line (struct screen *s)
+{
+  s->history (s->hist, s->hist_len, s->hist_offset, s->hist_time,
+              s->history_arg);
+  s->hist_len = 0;
+}
+
+/* Encode the text of L as UTF-8 into the output buffer, with
+   trailing blanks removed if TRIM is set. Returns the end of the
+   encoded text.  */
+static char *
+encode_line (struct screen *s, const struct line *l, int trim)
+{
+  const struct cell *c = l->cells;
+  const struct cell *ce = c + s->cols;
+  char *out = s->outbuf;
+
+  if (trim)
+    while (ce != c && ce[-1].ch == BLANK_CHAR)
+      --ce;
+  for (; c != ce; ++c)
+    out = put_utf8 (out, c->ch);
+  return out;
+}
+
+static int
+line_is_blank (struct screen *s, const struct line *l)
+{
+  const struct cell *c = l->cells;
+  const struct cell *ce = c + s->cols;
+
+  if (l->wrapped)
+    return 0;
+  for (; c != ce; ++c)
+    if (c->ch != BLANK_CHAR)
+      return 0;
+  return 1;
+}
+
+/* Add the text of L to the history. A line that wraps onto the next
+   is held back, and joined with the one that follows it.  */
+static void
+save_line (struct screen *s, const struct line *l)
+{
+  char *out = encode_line (s, l, !l->wrapped);
+  size_t len = out - s->outbuf;
+
+  if (s->hist_len + len + 1 > s->hist_size)
+    {
+      size_t size = 2 * (s->hist_len + len + 1);
+      char *hist = realloc (s->hist, size);
+      if (!hist)
+        {
+          if (s->handler)
+            s->handler (errno, s->handler_arg);
+          return;
+        }
+      s->hist = hist;
+      s->hist_size = size;
+    }
+  if (s->hist_len == 0)
+    {
+      s->hist_offset = l->offset;
+      s->hist_time = l->time;
+    }
+  memcpy (s->hist + s->hist_len, s->outbuf, len);
+  s->hist_len += len;
+  if (!l->wrapped)
+    end_history_line (s);
+}
+
+/* Save the lines of a screen buffer that's about to be erased, up to
+   the last one that isn't blank. */
+static void
+save_lines (struct screen *s, struct line **lines)
+{
+  size_t n = s->rows;
+  size_t i;
+
+  while (n != 0 && line_is_blank (s, lines[n - 1]))
+    --n;
+  for (i = 0; i != n; ++i)
+    save_line (s, lines[i]);
+  if (s->hist_len != 0)
+    end_history_line (s);
+}
+
+struct screen *
+screen_new (FILE *file, size_t cols, size_t rows)
+{
+  struct screen *s;
+  size_t i;
+
+  if (cols == 0 || rows == 0)
+    return NULL;
+  s = calloc (1, sizeof *s);
+  if (!s)
+    return NULL;
+  s->file = file;
+  s->cols = cols;
+  s->rows = rows;
+  s->lines = malloc (rows * sizeof *s->lines);
+  s->alt_lines = malloc (rows * sizeof *s->alt_lines);
+  s->spare = malloc (rows * sizeof *s->spare);
+  s->line_store = malloc (2 * rows * sizeof *s->line_store);
+  s->cell_store = malloc (2 * rows * cols * sizeof *s->cell_store);
+  s->stamp = malloc (rows * sizeof *s->stamp);
+  /* Worst case: four bytes of UTF-8 per cell, plus a newline. */
+  s->outbuf = malloc (4 * cols + 1);
+  if (!s->lines || !s->alt_lines || !s->spare || !s->line_store
+      || !s->cell_store || !s->stamp || !s->outbuf)
+    {
+      screen_delete (s);
+      return NULL;
+    }
+
+  s->cur.attr = ATTR_DEFAULT;
+  for (i = 0; i != 2 * rows; ++i)
+    {
+      struct line *l = &s->line_store[i];
+      l->cells = &s->cell_store[i * cols];
+      clear_line (s, l);
+      if (i < rows)
+        s->lines[i] = l;
+      else
+        s->alt_lines[i - rows] = l;
+    }
+  s->saved = s->cur;
+  s->top = 0;
+  s->bot = rows - 1;
+  s->autowrap = 1;
+  s->epoch = 1;
+  /* Even an untouched screen should be dumped once. */
+  mark_all_dirty (s);
+  return s;
+}
+
+void
+screen_set_handler (struct screen *s, screen_error_handler f, void *arg)
+{
+  s->handler = f;
+  s->handler_arg = arg;
+}
+
+/* When a history function is set, the text of lines that scroll off
+   the top of the (primary) screen, or that are on the screen when it
+   is erased in its entirety, is passed to it, as though it were going
+   into a terminal's scrollback buffer. Lines that were wrapped are
+   joined back together. Pass NULL to turn history off. */
+void
+screen_set_history (struct screen *s, screen_history_fn f, void *arg)
+{
+  s->history = f;
+  s->history_arg = arg;
+}
+
+/* Set the clock: the input offset and time that are recorded for
+   lines that are written to from now on (see screen_history_fn). */
+void
+screen_set_clock (struct screen *s, off_t offset, double time)
+{
+  s->clock_offset = offset;
+  s->clock_time = time;
+}
+
+/* Write the lines remaining on the primary screen to the history,
+   as at the end of input. */
+void
+screen_finish_history (struct screen *s)
+{
+  if (s->history)
+    save_lines (s, s->on_alt ? s->alt_lines : s->lines);
+}
+
+void
+screen_delete (struct screen *s)
+{
+  free (s->lines);
+  free (s->alt_lines);
+  free (s->spare);
+  free (s->line_store);
+  free (s->cell_store);
+  free (s->stamp);
+  free (s->outbuf);
+  free (s->hist);
+  free (s);
+}
+
+/* Scroll the lines from TOP to BOT (inclusive) up by N lines. The
+   lines that fall off the top are blanked and reused at the bottom. */
+static void
+scroll_up (struct screen *s, size_t top, size_t bot, size_t n)
+{
+  size_t height = bot - top + 1;
+  size_t i;
+
+  if (n > height)
+    n = height;
+  if (n == 0)
+    return;
+  if (s->history && top == 0 && !s->on_alt)
+    for (i = 0; i != n; ++i)
+      save_line (s, s->lines[i]);
+  memcpy (s->spare, &s->lines[top], n * sizeof *s->lines);
+  memmove (&s->lines[top], &s->lines[top + n],
+           (height - n) * sizeof *s->lines);
+  memcpy (&s->lines[bot + 1 - n], s->spare, n * sizeof *s->lines);
+  for (i = bot + 1 - n; i <= bot; ++i)
+    clear_line (s, s->lines[i]);
+  for (i = top; i <= bot; ++i)
+    mark_dirty (s, i);
+}
+
+/* Scroll the lines from TOP to BOT (inclusive) down by N lines. */
+static void
+scroll_down (struct screen *s, size_t top, size_t bot, size_t n)
+{
+  size_t height = bot - top + 1;
+  size_t i;
+
+  if (n > height)
+    n = height;
+  if (n == 0)
+    return;
+  memcpy (s->spare, &s->lines[bot + 1 - n], n * sizeof *s->lines);
+  memmove (&s->lines[top + n], &s->lines[top],
+           (height - n) * sizeof *s->lines);
+  memcpy (&s->lines[top], s->spare, n * sizeof *s->lines);
+  for (i = top; i != top + n; ++i)
+    clear_line (s, s->lines[i]);
+  for (i = top; i <= bot; ++i)
+    mark_dirty (s, i);
+}
+
+/* Move down a line, scrolling if we're at the bottom margin. */
+static void
+do_index (struct screen *s)
+{
+  s->wrap_pending = 0;
+  if (s->cur.y == s->bot)
+    scroll_up (s, s->top, s->bot, 1);
+  else if (s->cur.y + 1 < s->rows)
+    ++s->cur.y;
+}
+
+/* Move up a line, scrolling if we're at the top margin. */
+static void
+do_reverse_index (struct screen *s)
+{
+  s->wrap_pending = 0;
+  if (s->cur.y == s->top)
+    scroll_down (s, s->top, s->bot, 1);
+  else if (s->cur.y > 0)
+    --s->cur.y;
+}
+
+static void
+erase (struct screen *s, size_t row, size_t from, size_t to)
+{
+  struct line *l = s->lines[row];
+  if (to > s->cols)
+    to = s->cols;
+  if (from >= to)
+    return;
+  clear_cells (&l->cells[from], to - from,
+               ATTR_SET_FG (s->cur.attr, ATTR_COLOR_DEFAULT));
+  if (to == s->cols)
+    {
+      l->wrapped = 0;
+      if (from == 0)
+        l->fresh = 1;
+    }
+  mark_dirty (s, row);
+}
+
+/* Record when something was first written to L. */
+static void
+stamp_line (struct screen *s, struct line *l)
+{
+  l->fresh = 0;
+  l->offset = s->clock_offset;
+  l->time = s->clock_time;
+}
+
+static void
+put_char (struct screen *s, uint32_t ch)
+{
+  struct line *l;
+  struct cell *c;
+
+  if (s->wrap_pending)
+    {
+      s->lines[s->cur.y]->wrapped = 1;
+      s->cur.x = 0;
+      do_index (s);
+    }
+  l = s->lines[s->cur.y];
+  c = &l->cells[s->cur.x];
+  if (s->insert)
+    memmove (c + 1, c, (s->cols - s->cur.x - 1) * sizeof *c);
+  c->ch = ch;
+  c->attr = s->cur.attr;
+  if (l->fresh)
+    stamp_line (s, l);
+  mark_dirty (s, s->cur.y);
+  s->last_ch = ch;
+
+  if (s->cur.x + 1 < s->cols)
+    ++s->cur.x;
+  else
+    s->wrap_pending = s->autowrap;
+}
+
+static void
+do_control (struct screen *s, unsigned char c)
+{
+  switch (c)
+    {
+    case '\b':
+      if (s->wrap_pending)
+        s->wrap_pending = 0;
+      else if (s->cur.x > 0)
+        --s->cur.x;
+      break;
+    case '\t':
+      s->cur.x = (s->cur.x / TAB_WIDTH + 1) * TAB_WIDTH;
+      if (s->cur.x >= s->cols)
+        s->cur.x = s->cols - 1;
+      s->wrap_pending = 0;
+      break;
+    case '\n':
+    case '\v':
+    case '\f':
+      do_index (s);
+      break;
+    case '\r':
+      s->cur.x = 0;
+      s->wrap_pending = 0;
+      break;
+    }
+}
+
+void
+screen_putc (struct screen *s, unsigned char c)
+{
+  if (c >= 0x20 && c < 0x7f)
+    {
+      s->utf8_need = 0;
+      if (!s->wrap_pending && !s->insert && s->cur.x + 1 < s->cols)
+        {
+          /* Fast path for ordinary text. */
+          struct line *l = s->lines[s->cur.y];
+          struct cell *cell = &l->cells[s->cur.x++];
+          if (l->fresh)
+            stamp_line (s, l);
+          cell->ch = c;
+          cell->attr = s->cur.attr;
+          s->last_ch = c;
+          s->stamp[s->cur.y] = s->last_change = s->epoch;
+        }
+      else
+        put_char (s, c);
+      return;
+    }
+  if (c < 0x80)
+    {
+      s->utf8_need = 0;
+      do_control (s, c);
+      return;
+    }
+
+  /* UTF-8. */
+  if ((c & 0xc0) == 0x80)
+    {
+      if (s->utf8_need == 0)
+        {
+          put_char (s, REPLACEMENT_CHAR);
+          return;
+        }
+      s->utf8_ch = (s->utf8_ch << 6) | (c & 0x3f);
+      if (--s->utf8_need == 0)
+        put_char (s, s->utf8_ch);
+      return;
+    }
+  if (s->utf8_need)
+    put_char (s, REPLACEMENT_CHAR);
+  if ((c & 0xe0) == 0xc0)
+    {
+      s->utf8_ch = c & 0x1f;
+      s->utf8_need = 1;
+    }
+  else if ((c & 0xf0) == 0xe0)
+    {
+      s->utf8_ch = c & 0x0f;
+      s->utf8_need = 2;
+    }
+  else if ((c & 0xf8) == 0xf0)
+    {
+      s->utf8_ch = c & 0x07;
+      s->utf8_need = 3;
+    }
+  else
+    {
+      s->utf8_need = 0;
+      put_char (s, REPLACEMENT_CHAR);
+    }
+}
+
+/* Write the LEN printable ASCII characters at BUF, as screen_putc
+   would one at a time, but a row's worth at a time. */
+void
+screen_write (struct screen *s, const unsigned char *buf, size_t len)
+{
+  const unsigned char *end = buf + len;
+
+  s->utf8_need = 0;
+  while (buf != end)
+    {
+      size_t n = s->cols - s->cur.x - 1;
+      struct line *l;
+      struct cell *c, *ce;
+
+      /* Up to the last column; the character there, and anything
+         that wraps or is inserted, goes the slow way. */
+      if (s->wrap_pending || s->insert || n == 0)
+        {
+          put_char (s, *buf++);
+          continue;
+        }
+      if (n > (size_t) (end - buf))
+        n = end - buf;
+      l = s->lines[s->cur.y];
+      if (l->fresh)
+        stamp_line (s, l);
+      for (c = &l->cells[s->cur.x], ce = c + n; c != ce; ++c)
+        {
+          c->ch = *buf++;
+          c->attr = s->cur.attr;
+        }
+      s->cur.x += n;
+      s->last_ch = buf[-1];
+      mark_dirty (s, s->cur.y);
+    }
+}
+
+static void
+move_to (struct screen *s, size_t x, size_t y)
+{
+  size_t miny = 0, maxy = s->rows - 1;
+  if (s->cur.origin)
+    {
+      y += s->top;
+      miny = s->top;
+      maxy = s->bot;
+    }
+  if (y < miny)
+    y = miny;
+  if (y > maxy)
+    y = maxy;
+  if (x >= s->cols)
+    x = s->cols - 1;
+  s->cur.x = x;
+  s->cur.y = y;
+  s->wrap_pending = 0;
+}
+
+static void
+save_cursor (struct screen *s)
+{
+  s->saved = s->cur;
+}
+
+static void
+restore_cursor (struct screen *s)
+{
+  s->cur = s->saved;
+  if (s->cur.x >= s->cols)
+    s->cur.x = s->cols - 1;
+  if (s->cur.y >= s->rows)
+    s->cur.y = s->rows - 1;
+  s->wrap_pending = 0;
+}
+
+static void
+switch_buffer (struct screen *s, int alt)
+{
+  struct line **tmp;
+  size_t i;
+
+  if (alt == s->on_alt)
+    return;
+  tmp = s->lines;
+  s->lines = s->alt_lines;
+  s->alt_lines = tmp;
+  s->on_alt = alt;
+  if (alt)
+    for (i = 0; i != s->rows; ++i)
+      clear_line (s, s->lines[i]);
+  mark_all_dirty (s);
+}
+
+static void
+reset (struct screen *s)
+{
+  size_t i;
+
+  switch_buffer (s, 0);
+  if (s->history)
+    save_lines (s, s->lines);
+  s->cur.attr = ATTR_DEFAULT;
+  s->cur.x = s->cur.y = 0;
+  s->cur.origin = 0;
+  s->saved = s->cur;
+  s->wrap_pending = 0;
+  s->top = 0;
+  s->bot = s->rows - 1;
+  s->insert = 0;
+  s->autowrap = 1;
+  for (i = 0; i != s->rows; ++i)
+    clear_line (s, s->lines[i]);
+  mark_all_dirty (s);
+}
+
+static void
+set_mode (struct screen *s, unsigned char priv, unsigned int mode, int set)
+{
+  if (priv == 0)
+    {
+      if (mode == MODE_IRM)
+        s->insert = set;
+      return;
+    }
+  if (priv != '?')
+    return;
+  switch (mode)
+    {
+    case 6:
+      s->cur.origin = set;
+      move_to (s, 0, 0);
+      break;
+    case 7:
+      s->autowrap = set;
+      if (!set)
+        s->wrap_pending = 0;
+      break;
+    case 47:
+    case 1047:
+      switch_buffer (s, set);
+      break;
+    case 1048:
+      if (set)
+        save_cursor (s);
+      else
+        restore_cursor (s);
+      break;
+    case 1049:
+      if (set)
+        {
+          save_cursor (s);
+          switch_buffer (s, 1);
+        }
+      else
+        {
+          switch_buffer (s, 0);
+          restore_cursor (s);
+        }
+      break;
+    }
+}
+
+/* Map a 24-bit color to the nearest entry of the 6x6x6 color cube. */
+static unsigned int
+rgb_to_index (unsigned int r, unsigned int g, unsigned int b)
+{
+#define CUBE(v) ((v) > 255 ? 5 : ((v) * 5 + 127) / 255)
+  return 16 + 36 * CUBE (r) + 6 * CUBE (g) + CUBE (b);
+#undef CUBE
+}
+
+/* Handle the extended color forms "38;5;N" and "38;2;R;G;B" (and
+   their background equivalents). Returns the number of additional
+   parameters consumed. */
+static size_t
+sgr_extended_color (struct screen *s, int bg, size_t n_params,
+                    unsigned int *params)
+{
+  unsigned int color;
+  size_t used;
+
+  if (n_params < 2)
+    return 0;
+  if (params[1] == 5 && n_params >= 3)
+    {
+      color = params[2] & 0xff;
+      used = 2;
+    }
+  else if (params[1] == 2 && n_params >= 5)
+    {
+      color = rgb_to_index (params[2], params[3], params[4]);
+      used = 4;
+    }
+  else
+    return n_params - 1;
+  if (bg)
+    s->cur.attr = ATTR_SET_BG (s->cur.attr, color);
+  else
+    s->cur.attr = ATTR_SET_FG (s->cur.attr, color);
+  return used;
+}
+
+static void
+do_sgr (struct screen *s, size_t n_params, unsigned int *params)
+{
+  size_t i;
+  uint32_t a = s->cur.attr;
+
+  if (n_params == 0)
+    {
+      s->cur.attr = ATTR_DEFAULT;
+      return;
+    }
+  for (i = 0; i < n_params; ++i)
+    {
+      unsigned int p = params[i];
+      a = s->cur.attr;
+      switch (p)
+        {
+        case 0: a = ATTR_DEFAULT; break;
+        case 1: a |= ATTR_BOLD; break;
+        case 2: a |= ATTR_DIM; break;
+        case 3: a |= ATTR_ITALIC; break;
+        case 4: case 21: a |= ATTR_UNDERLINE; break;
+        case 5: case 6: a |= ATTR_BLINK; break;
+        case 7: a |= ATTR_INVERSE; break;
+        case 8: a |= ATTR_HIDDEN; break;
+        case 9: a |= ATTR_STRIKE; break;
+        case 22: a &= ~(ATTR_BOLD | ATTR_DIM); break;
+        case 23: a &= ~ATTR_ITALIC; break;
+        case 24: a &= ~ATTR_UNDERLINE; break;
+        case 25: a &= ~ATTR_BLINK; break;
+        case 27: a &= ~ATTR_INVERSE; break;
+        case 28: a &= ~ATTR_HIDDEN; break;
+        case 29: a &= ~ATTR_STRIKE; break;
+        case 38:
+        case 48:
+          i += sgr_extended_color (s, p == 48, n_params - i, &params[i]);
+          continue;
+        case 39: a = ATTR_SET_FG (a, ATTR_COLOR_DEFAULT); break;
+        case 49: a = ATTR_SET_BG (a, ATTR_COLOR_DEFAULT); break;
+        default:
+          if (p >= 30 && p <= 37)
+            a = ATTR_SET_FG (a, p - 30);
+          else if (p >= 40 && p <= 47)
+            a = ATTR_SET_BG (a, p - 40);
+          else if (p >= 90 && p <= 97)
+            a = ATTR_SET_FG (a, p - 90 + 8);
+          else if (p >= 100 && p <= 107)
+            a = ATTR_SET_BG (a, p - 100 + 8);
+        }
+      s->cur.attr = a;
+    }
+}
+
+/* Parameter I, or DEF if it was absent or zero. */
+#define PARAM(i, def)   ((i) < n_params && params[i] != 0 ? params[i] : (def))
+
+void
+screen_csi (struct screen *s, unsigned char final, unsigned char priv,
+            unsigned char interm, size_t n_params, unsigned int params[])
+{
+  struct line *l = s->lines[s->cur.y];
+  size_t n, i;
+
+  if (interm != 0)
+    return;
+  if (final == 'h' || final == 'l')
+    {
+      for (i = 0; i != n_params; ++i)
+        set_mode (s, priv, params[i], final == 'h');
+      return;
+    }
+  if (priv != 0)
+    return;
+
+  n = PARAM (0, 1);
+  switch (final)
+    {
+    case '@':                   /* ICH */
+      if (n > s->cols - s->cur.x)
+        n = s->cols - s->cur.x;
+      memmove (&l->cells[s->cur.x + n], &l->cells[s->cur.x],
+               (s->cols - s->cur.x - n) * sizeof *l->cells);
+      erase (s, s->cur.y, s->cur.x, s->cur.x + n);
+      s->wrap_pending = 0;
+      break;
+    case 'A':                   /* CUU */
+      if (s->cur.y >= s->top && s->cur.y - s->top < n)
+        n = s->cur.y - s->top;
+      else if (s->cur.y < n)
+        n = s->cur.y;
+      s->cur.y -= n;
+      s->wrap_pending = 0;
+      break;
+    case 'B':                   /* CUD */
+    case 'e':                   /* VPR */
+      if (s->cur.y <= s->bot && s->bot - s->cur.y < n)
+        n = s->bot - s->cur.y;
+      else if (s->rows - 1 - s->cur.y < n)
+        n = s->rows - 1 - s->cur.y;
+      s->cur.y += n;
+      s->wrap_pending = 0;
+      break;
+    case 'C':                   /* CUF */
+    case 'a':                   /* HPR */
+      if (s->cols - 1 - s->cur.x < n)
+        n = s->cols - 1 - s->cur.x;
+      s->cur.x += n;
+      s->wrap_pending = 0;
+      break;
+    case 'D':                   /* CUB */
+      if (s->cur.x < n)
+        n = s->cur.x;
+      s->cur.x -= n;
+      s->wrap_pending = 0;
+      break;
+    case 'E':                   /* CNL */
+      s->cur.x = 0;
+      screen_csi (s, 'B', 0, 0, n_params, params);
+      break;
+    case 'F':                   /* CPL */
+      s->cur.x = 0;
+      screen_csi (s, 'A', 0, 0, n_params, params);
+      break;
+    case 'G':                   /* CHA */
+    case '`':                   /* HPA */
+      s->cur.x = (n > s->cols ? s->cols : n) - 1;
+      s->wrap_pending = 0;
+      break;
+    case 'H':                   /* CUP */
+    case 'f':                   /* HVP */
+      move_to (s, PARAM (1, 1) - 1, n - 1);
+      break;
+    case 'd':                   /* VPA */
+      move_to (s, s->cur.x, n - 1);
+      break;
+    case 'I':                   /* CHT */
+      for (i = 0; i != n; ++i)
+        do_control (s, '\t');
+      break;
+    case 'Z':                   /* CBT */
+      for (i = 0; i != n && s->cur.x > 0; ++i)
+        s->cur.x = (s->cur.x - 1) / TAB_WIDTH * TAB_WIDTH;
+      s->wrap_pending = 0;
+      break;
+    case 'J':                   /* ED */
+      switch (PARAM (0, 0))
+        {
+        case 0:
+          /* From the home position, this erases the whole screen, as
+             clear(1) does. */
+          if (s->history && !s->on_alt && s->cur.x == 0 && s->cur.y == 0)
+            save_lines (s, s->lines);
+          erase (s, s->cur.y, s->cur.x, s->cols);
+          for (i = s->cur.y + 1; i < s->rows; ++i)
+            erase (s, i, 0, s->cols);
+          break;
+        case 1:
+          for (i = 0; i != s->cur.y; ++i)
+            erase (s, i, 0, s->cols);
+          erase (s, s->cur.y, 0, s->cur.x + 1);
+          break;
+        case 2:
+        case 3:
+          if (s->history && !s->on_alt)
+            save_lines (s, s->lines);
+          for (i = 0; i != s->rows; ++i)
+            erase (s, i, 0, s->cols);
+          break;
+        }
+      break;
+    case 'K':                   /* EL */
+      switch (PARAM (0, 0))
+        {
+        case 0:
+          erase (s, s->cur.y, s->cur.x, s->cols);
+          break;
+        case 1:
+          erase (s, s->cur.y, 0, s->cur.x + 1);
+          break;
+        case 2:
+          erase (s, s->cur.y, 0, s->cols);
+          break;
+        }
+      break;
+    case 'L':                   /* IL */
+      if (s->cur.y >= s->top && s->cur.y <= s->bot)
+        scroll_down (s, s->cur.y, s->bot, n);
+      s->wrap_pending = 0;
+      break;
+    case 'M':                   /* DL */
+      if (s->cur.y >= s->top && s->cur.y <= s->bot)
+        scroll_up (s, s->cur.y, s->bot, n);
+      s->wrap_pending = 0;
+      break;
+    case 'P':                   /* DCH */
+      if (n > s->cols - s->cur.x)
+        n = s->cols - s->cur.x;
+      memmove (&l->cells[s->cur.x], &l->cells[s->cur.x + n],
+               (s->cols - s->cur.x - n) * sizeof *l->cells);
+      erase (s, s->cur.y, s->cols - n, s->cols);
+      s->wrap_pending = 0;
+      break;
+    case 'X':                   /* ECH */
+      erase (s, s->cur.y, s->cur.x, s->cur.x + n);
+      break;
+    case 'S':                   /* SU */
+      scroll_up (s, s->top, s->bot, n);
+      break;
+    case 'T':                   /* SD */
+      if (n_params <= 1)
+        scroll_down (s, s->top, s->bot, n);
+      break;
+    case 'b':                   /* REP */
+      if (s->last_ch)
+        for (i = 0; i != n && i != s->cols * s->rows; ++i)
+          put_char (s, s->last_ch);
+      break;
+    case 'm':                   /* SGR */
+      do_sgr (s, n_params, params);
+      break;
+    case 'r':                   /* DECSTBM */
+      {
+        size_t top = PARAM (0, 1) - 1;
+        size_t bot = PARAM (1, s->rows) - 1;
+        if (bot >= s->rows)
+          bot = s->rows - 1;
+        if (top < bot)
+          {
+            s->top = top;
+            s->bot = bot;
+            move_to (s, 0, 0);
+          }
+      }
+      break;
+    case 's':
+      if (n_params == 0)
+        save_cursor (s);
+      break;
+    case 'u':
+      restore_cursor (s);
+      break;
+    }
+}
+
+void
+screen_esc (struct screen *s, unsigned char c)
+{
+  switch (c)
+    {
+    case '7':                   /* DECSC */
+      save_cursor (s);
+      break;
+    case '8':                   /* DECRC */
+      restore_cursor (s);
+      break;
+    case 'D':                   /* IND */
+      do_index (s);
+      break;
+    case 'E':                   /* NEL */
+      s->cur.x = 0;
+      do_index (s);
+      break;
+    case 'M':                   /* RI */
+      do_reverse_index (s);
+      break;
+    case 'c':                   /* RIS */
+      reset (s);
+      break;
+    }
+}
+
+int
+screen_is_dirty (struct screen *s)
+{
+  return s->last_change > s->dumped;
+}
+
+/* Write out each row of the display, with trailing blanks removed.
+   Returns 0 on success, or -1 on a write error (errno is set). */
+int
+screen_dump (struct screen *s)
+{
+  size_t row;
+
+  for (row = 0; row != s->rows; ++row)
+    {
+      char *out = encode_line (s, s->lines[row], 1);
+
+      *out++ = '\n';
+      if (fwrite (s->outbuf, 1, out - s->outbuf, s->file)
+          != (size_t)(out - s->outbuf))
+        return -1;
+    }
+  s->dumped = s->epoch++;
+  return 0;
+}
+
+/* Write the attributes of ROW to F as runs of "COUNT:ATTR", where
+   ATTR is the packed attribute word in hexadecimal. A trailing run of
+   default attributes is left out, and nothing at all is written for
+   a row that has only default attributes.  */
+static int
+write_attr_runs (struct screen *s, FILE *f, size_t row)
+{
+  const struct cell *c = s->lines[row]->cells;
+  size_t end = s->cols;
+  size_t i, run;
+
+  while (end != 0 && c[end - 1].attr == ATTR_DEFAULT)
+    --end;
+  if (end == 0)
+    return 0;
+  if (fprintf (f, "A %lu", (unsigned long) row + 1) < 0)
+    return -1;
+  for (i = 0; i != end; i += run)
+    {
+      for (run = 1; i + run != end && c[i + run].attr == c[i].attr; ++run)
+        ;
+      if (fprintf (f, " %lu:%lx", (unsigned long) run,
+                   (unsigned long) c[i].attr) < 0)
+        return -1;
+    }
+  return putc ('\n', f) == EOF ? -1 : 0;
+}
+
+/* Write to F those rows that have changed since the epoch *SINCE
+   (or every row, if FULL is set): a line "R ROW TEXT" with the row's
+   text, followed by an "A ROW RUNS..." line if the row has any
+   non-default attributes. Rows are numbered from 1. *SINCE is
+   updated so that the next call writes only what changes after this
+   one. Returns 0 on success, or -1 on a write error (errno is set). */
+int
+screen_snapshot (struct screen *s, FILE *f, unsigned long *since, int full)
+{
+  size_t row;
+
+  for (row = 0; row != s->rows; ++row)
+    {
+      char *out;
+
+      if (!full && s->stamp[row] <= *since)
+        continue;
+      out = encode_line (s, s->lines[row], 1);
+      if (fprintf (f, "R %lu ", (unsigned long) row + 1) < 0
+          || fwrite (s->outbuf, 1, out - s->outbuf, f)
+             != (size_t)(out - s->outbuf)
+          || putc ('\n', f) == EOF
+          || write_attr_runs (s, f, row) != 0)
+        return -1;
+    }
+  *since = s->epoch++;
+  return 0;
+}
+
+/* Has anything changed since the epoch SINCE?  */
+int
+screen_changed_since (struct screen *s, unsigned long since)
+{
+  return s->last_change > since;
+}
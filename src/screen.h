@@ -0,0 +1,84 @@
+/* screen.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Screen model.
+
+    Keeps a grid of character cells, the cursor position, the
+    scrolling region and the current graphic rendition, and updates
+    them in response to the characters and control functions that
+    teseq has decoded. The contents of the display can then be written
+    out as plain (UTF-8) text.
+
+    Rows that have been changed since the last call to screen_dump are
+    tracked, so that callers can skip dumping a screen that hasn't
+    changed. Alternatively, the text of lines as they leave the screen
+    can be passed to a history function, as a plain-text history.
+    Snapshot writers track changes independently, through an epoch of
+    their own that screen_snapshot advances.
+*/
+
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include "teseq.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#define SCREEN_DEFAULT_COLS     80
+#define SCREEN_DEFAULT_ROWS     24
+
+struct screen;
+
+/* A screen_error_handler gets the current value of errno, and the
+   arg passed to screen_set_handler. */
+typedef void (*screen_error_handler)(int, void *);
+
+/* A screen_history_fn gets the text of a line (not null-terminated,
+   and without a newline), the input offset and time from the clock at
+   the point where the line was first written to, and the arg passed
+   to screen_set_history. */
+typedef void (*screen_history_fn)(const char *, size_t, off_t, double,
+                                  void *);
+
+struct screen *screen_new (FILE *, size_t cols, size_t rows);
+void screen_set_handler (struct screen *, screen_error_handler, void *);
+void screen_delete (struct screen *);
+
+void screen_set_history (struct screen *, screen_history_fn, void *);
+void screen_set_clock (struct screen *, off_t, double);
+void screen_finish_history (struct screen *);
+
+void screen_putc (struct screen *, unsigned char);
+void screen_write (struct screen *, const unsigned char *, size_t);
+void screen_csi (struct screen *, unsigned char final, unsigned char priv,
+                 unsigned char interm, size_t n_params, unsigned int params[]);
+void screen_esc (struct screen *, unsigned char);
+
+int screen_is_dirty (struct screen *);
+int screen_dump (struct screen *);
+
+int screen_changed_since (struct screen *, unsigned long);
+int screen_snapshot (struct screen *, FILE *, unsigned long *since, int full);
+
+#endif
@@ -0,0 +1,434 @@
+/* server.c: decoding many streams at once, for --listen. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* For accept4 and fopencookie. */
+#define _GNU_SOURCE
+
+#include "teseq.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "server.h"
+
+extern const char *program_name;
+
+#ifdef HAVE_SERVER
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* How much of a stream's input a thread takes at a time. */
+#define READ_SIZE       16384
+
+/* The output is handed to the stream's buffer in pieces of (at most)
+   this size. */
+#define WRITE_SIZE      2048
+
+/* How many processors from finished streams are kept for reuse. */
+#define POOL_MAX        64
+
+/* What a stream is waiting for next. */
+enum
+{
+  WAIT_INPUT,
+  WAIT_OUTPUT,                  /* Room to send what's backed up. */
+  WAIT_DONE                     /* Nothing: it's finished with. */
+};
+
+struct stream
+{
+  int fd;
+  FILE *outf;                   /* Writes to out, below. */
+  struct processor *proc;
+  char *out;                    /* Output not yet sent: from */
+  size_t out_start;             /* out_start to out_end. */
+  size_t out_end;
+  size_t out_size;
+  int ended;                    /* All the input has been read. */
+  int failed;                   /* Writing to the client failed. */
+};
+
+static const struct config *config;
+static int epfd;
+static int listen_fd;
+static int spare_fd = -1;       /* Given up to turn a connection away
+                                   when out of descriptors. */
+
+static struct processor *pool[POOL_MAX];
+static size_t pool_n;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A processor writing to OUTF: one from the pool if there is one. */
+static struct processor *
+get_processor (FILE *outf)
+{
+  struct processor *proc = NULL;
+
+  pthread_mutex_lock (&pool_lock);
+  if (pool_n)
+    proc = pool[--pool_n];
+  pthread_mutex_unlock (&pool_lock);
+  return proc ? processor_reuse (proc, outf) : processor_new (config, outf);
+}
+
+/* Done with PROC: keep it for the next stream, if there's room. */
+static void
+put_processor (struct processor *proc)
+{
+  pthread_mutex_lock (&pool_lock);
+  if (pool_n != POOL_MAX)
+    {
+      pool[pool_n++] = proc;
+      proc = NULL;
+    }
+  pthread_mutex_unlock (&pool_lock);
+  if (proc)
+    processor_delete (proc);
+}
+
+static void
+stream_write_error (int e, void *arg)
+{
+  struct stream *s = arg;
+  (void) e;
+  s->failed = 1;
+}
+
+/* The stream's output is kept until the client has room for it, so
+   that a client that doesn't read can't hold up a thread. */
+static ssize_t
+stream_write (void *cookie, const char *buf, size_t size)
+{
+  struct stream *s = cookie;
+
+  if (s->out_size - s->out_end < size && s->out_start)
+    {
+      /* Make room where what's been sent was. */
+      memmove (s->out, s->out + s->out_start, s->out_end - s->out_start);
+      s->out_end -= s->out_start;
+      s->out_start = 0;
+    }
+  if (s->out_size - s->out_end < size)
+    {
+      size_t new_size = s->out_size ? s->out_size : WRITE_SIZE;
+      char *grown;
+
+      while (new_size - s->out_end < size)
+        new_size *= 2;
+      grown = realloc (s->out, new_size);
+      if (!grown)
+        {
+          errno = ENOMEM;
+          return -1;
+        }
+      s->out = grown;
+      s->out_size = new_size;
+    }
+  memcpy (s->out + s->out_end, buf, size);
+  s->out_end += size;
+  return size;
+}
+
+static void
+stream_delete (struct stream *s)
+{
+  if (s->proc)
+    put_processor (s->proc);
+  if (s->outf)
+    fclose (s->outf);
+  close (s->fd);
+  free (s->out);
+  free (s);
+}
+
+/* Wait for EVENTS on FD, for S (or for the next connection, if S is
+   NULL). */
+static void
+rearm (int fd, struct stream *s, unsigned events)
+{
+  struct epoll_event ev;
+
+  ev.events = events | EPOLLONESHOT;
+  ev.data.ptr = s;
+  epoll_ctl (epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+/* Out of descriptors: give up the spare one to accept the waiting
+   connection, and turn it away, rather than have it come straight
+   back from epoll_wait. */
+static void
+turn_away (void)
+{
+  int fd;
+
+  if (spare_fd == -1)
+    return;
+  close (spare_fd);
+  fd = accept (listen_fd, NULL, NULL);
+  if (fd != -1)
+    close (fd);
+  spare_fd = open ("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+static void
+accept_streams (void)
+{
+  cookie_io_functions_t funcs = { NULL, NULL, NULL, NULL };
+  int fd;
+
+  funcs.write = stream_write;
+  for (;;)
+    {
+      struct epoll_event ev;
+      struct stream *s;
+
+      fd = accept4 (listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd == -1)
+        {
+          if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+          if (errno == EMFILE || errno == ENFILE)
+            turn_away ();
+          break;
+        }
+      s = calloc (1, sizeof *s);
+      if (s)
+        {
+          s->fd = fd;
+          s->outf = fopencookie (s, "w", funcs);
+        }
+      if (s && s->outf)
+        {
+          setvbuf (s->outf, NULL, _IOFBF, WRITE_SIZE);
+          s->proc = get_processor (s->outf);
+        }
+      if (!s || !s->proc)
+        {
+          if (s)
+            stream_delete (s);
+          else
+            close (fd);
+          continue;
+        }
+      processor_set_handler (s->proc, stream_write_error, s);
+
+      ev.events = EPOLLIN | EPOLLONESHOT;
+      ev.data.ptr = s;
+      if (epoll_ctl (epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        stream_delete (s);
+    }
+  rearm (listen_fd, NULL, EPOLLIN);
+}
+
+/* Send as much of S's output as the client has room for. Returns
+   what S should wait for next. */
+static int
+send_output (struct stream *s)
+{
+  while (s->out_start != s->out_end)
+    {
+      ssize_t n = send (s->fd, s->out + s->out_start,
+                        s->out_end - s->out_start, MSG_NOSIGNAL);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return WAIT_OUTPUT;
+      if (n == -1)
+        return WAIT_DONE;
+      s->out_start += n;
+    }
+  return s->ended ? WAIT_DONE : WAIT_INPUT;
+}
+
+/* Feed S whatever it has waiting, once its earlier output is all
+   sent; no more is read while it isn't. Returns what S should wait
+   for next. */
+static int
+serve_stream (struct stream *s, unsigned char *buf)
+{
+  ssize_t n;
+
+  if (s->out_start != s->out_end || s->ended)
+    return send_output (s);
+  n = recv (s->fd, buf, READ_SIZE, 0);
+  if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK
+                  || errno == EINTR))
+    return WAIT_INPUT;
+  if (n == -1)
+    return WAIT_DONE;
+  if (n > 0)
+    processor_feed (s->proc, buf, n);
+  else
+    {
+      processor_feed (s->proc, NULL, 0);
+      processor_finish (s->proc);
+      s->ended = 1;
+    }
+  if (fflush (s->outf) != 0)
+    s->failed = 1;
+  return s->failed ? WAIT_DONE : send_output (s);
+}
+
+static void *
+worker (void *arg)
+{
+  unsigned char buf[READ_SIZE];
+
+  (void) arg;
+  for (;;)
+    {
+      struct epoll_event ev;
+      struct stream *s;
+
+      if (epoll_wait (epfd, &ev, 1, -1) != 1)
+        continue;
+      s = ev.data.ptr;
+      if (s == NULL)
+        accept_streams ();
+      else
+        switch (serve_stream (s, buf))
+          {
+          case WAIT_INPUT:
+            rearm (s->fd, s, EPOLLIN);
+            break;
+          case WAIT_OUTPUT:
+            rearm (s->fd, s, EPOLLOUT);
+            break;
+          default:
+            epoll_ctl (epfd, EPOLL_CTL_DEL, s->fd, NULL);
+            stream_delete (s);
+            break;
+          }
+    }
+  return NULL;
+}
+
+static int
+listen_on (const char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen (path) >= sizeof addr.sun_path)
+    {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+  memset (&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+
+  fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+  unlink (path);
+  if (bind (fd, (struct sockaddr *) &addr, sizeof addr) != 0
+      || listen (fd, SOMAXCONN) != 0)
+    {
+      int e = errno;
+      close (fd);
+      errno = e;
+      return -1;
+    }
+  return fd;
+}
+
+/* Serve connections to the socket given by CFG, until interrupted. */
+int
+server_run (const struct config *cfg)
+{
+  const char *path = cfg->listen;
+  long threads = cfg->threads;
+  struct epoll_event ev;
+  sigset_t mask;
+  pthread_t tid;
+  int sig;
+  long i;
+
+  config = cfg;
+  if (threads <= 0)
+    threads = sysconf (_SC_NPROCESSORS_ONLN);
+  if (threads <= 0)
+    threads = 1;
+
+  /* A client that goes away shows up as a write error on its stream. */
+  signal (SIGPIPE, SIG_IGN);
+  /* Leave SIGINT and SIGTERM to this thread, for shutting down. */
+  sigemptyset (&mask);
+  sigaddset (&mask, SIGINT);
+  sigaddset (&mask, SIGTERM);
+  pthread_sigmask (SIG_BLOCK, &mask, NULL);
+
+  spare_fd = open ("/dev/null", O_RDONLY | O_CLOEXEC);
+  listen_fd = listen_on (path);
+  if (listen_fd == -1)
+    {
+      fprintf (stderr, "%s: couldn't listen on %s: %s\n", program_name,
+               path, strerror (errno));
+      return EXIT_FAILURE;
+    }
+  epfd = epoll_create1 (EPOLL_CLOEXEC);
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.ptr = NULL;
+  if (epfd == -1 || epoll_ctl (epfd, EPOLL_CTL_ADD, listen_fd, &ev) != 0)
+    {
+      fprintf (stderr, "%s: %s\n", program_name, strerror (errno));
+      unlink (path);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i != threads; ++i)
+    if (pthread_create (&tid, NULL, worker, NULL) != 0)
+      {
+        if (i == 0)
+          {
+            fprintf (stderr, "%s: couldn't start a thread\n",
+                     program_name);
+            unlink (path);
+            return EXIT_FAILURE;
+          }
+        break;
+      }
+
+  sigwait (&mask, &sig);
+  unlink (path);
+  return EXIT_SUCCESS;
+}
+
+#else
+
+int
+server_run (const struct config *cfg)
+{
+  fprintf (stderr, "%s: --listen isn't supported on this system.\n",
+           program_name);
+  return EXIT_FAILURE;
+}
+
+#endif /* HAVE_SERVER */
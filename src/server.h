@@ -0,0 +1,47 @@
+/* server.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Server mode.
+
+    With --listen, teseq accepts connections on a Unix-domain socket,
+    and decodes each one as a separate stream, writing the result back
+    over the same connection as it goes; the client shuts down its
+    side to mark the end of the stream. A fixed pool of threads waits
+    on a single epoll instance; each stream is handed to one thread at
+    a time, which feeds whatever has arrived to the stream's processor
+    and goes back to waiting. Only the processor's own few kilobytes
+    are kept per stream, so idle connections are cheap.
+*/
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "teseq.h"
+
+#if defined (HAVE_SYS_EPOLL_H) && defined (HAVE_PTHREAD_H) \
+    && defined (HAVE_FOPENCOOKIE)
+#  define HAVE_SERVER   1
+#endif
+
+int server_run (const struct config *);
+
+#endif
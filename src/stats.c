@@ -0,0 +1,320 @@
+/* stats.c: counts of the control functions in the input. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "teseq.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "csi.h"
+#include "stats.h"
+
+/* Acronyms for the nF escape sequences, by intermediate byte. */
+static const char *nf_acros[0x10] = {
+  "ACS", "CZD", "C1D", NULL, "GZDM4", "DOCS", NULL, NULL,
+  "GZD4", "G1D4", "G2D4", "G3D4", NULL, "G1D6", "G2D6", "G3D6"
+};
+
+struct entry
+{
+  char seq[16];
+  const char *acro;
+  uintmax_t count;
+};
+
+struct stats *
+stats_new (void)
+{
+  return calloc (1, sizeof (struct stats));
+}
+
+void
+stats_delete (struct stats *st)
+{
+  free (st);
+}
+
+/* Count a control sequence. The bytes it took up are counted by the
+   stats_escape call that follows. */
+void
+stats_csi (struct stats *st, unsigned char private_indicator,
+           unsigned char interm, unsigned char final,
+           size_t n_params, const unsigned int params[])
+{
+  size_t pi = private_indicator ? private_indicator - 0x39 : 0;
+  size_t ii = interm ? interm - 0x1f : 0;
+
+  ++st->csi[pi][ii][final - 0x40];
+  ++st->n_params[n_params < STATS_MAX_PARAMS ? n_params : STATS_MAX_PARAMS];
+  if (final == 'm' && pi == 0 && ii == 0)
+    {
+      size_t i;
+      for (i = 0; i != n_params; ++i)
+        ++st->sgr[params[i] < 255 ? params[i] : 255];
+    }
+  st->in_csi = 1;
+}
+
+/* Count an escape sequence of LEN bytes, whose first byte after the
+   Esc is C. */
+void
+stats_escape (struct stats *st, unsigned char c, size_t len)
+{
+  ++st->sequences;
+  if (len > st->longest)
+    st->longest = len;
+  if (st->in_csi)
+    {
+      st->csi_bytes += len;
+      st->in_csi = 0;
+    }
+  else
+    {
+      st->esc_bytes += len;
+      ++st->esc[c - 0x20];
+    }
+}
+
+static int
+compare_entries (const void *va, const void *vb)
+{
+  const struct entry *a = va;
+  const struct entry *b = vb;
+
+  if (a->count != b->count)
+    return a->count < b->count ? 1 : -1;
+  return strcmp (a->seq, b->seq);
+}
+
+/* Collect the nonzero control sequence counts into ENTRIES. */
+static size_t
+csi_entries (struct stats *st, struct entry *entries)
+{
+  size_t pi, ii, fi, n = 0;
+
+  for (pi = 0; pi != 7; ++pi)
+    for (ii = 0; ii != 17; ++ii)
+      for (fi = 0; fi != 0x3f; ++fi)
+        {
+          int priv = pi ? pi + 0x39 : 0;
+          int interm = ii ? ii + 0x1f : 0;
+          struct entry *e;
+          char *s;
+
+          if (!st->csi[pi][ii][fi])
+            continue;
+          e = &entries[n++];
+          s = e->seq;
+          s += sprintf (s, "CSI");
+          if (priv)
+            s += sprintf (s, " %c", priv);
+          if (interm == ' ')
+            s += sprintf (s, " SP");
+          else if (interm)
+            s += sprintf (s, " %c", interm);
+          sprintf (s, " %c", (int) fi + 0x40);
+          e->acro = get_csi_handler (priv, interm != 0, interm,
+                                     fi + 0x40)->acro;
+          e->count = st->csi[pi][ii][fi];
+        }
+  return n;
+}
+
+/* Collect the nonzero escape sequence counts into ENTRIES. */
+static size_t
+esc_entries (struct stats *st, struct entry *entries)
+{
+  size_t i, n = 0;
+
+  for (i = 0; i != N_ARY_ELEMS (st->esc); ++i)
+    {
+      unsigned char c = i + 0x20;
+      struct entry *e;
+      const char *name;
+
+      if (!st->esc[i])
+        continue;
+      e = &entries[n++];
+      if (c == ' ')
+        strcpy (e->seq, "Esc SP");
+      else
+        sprintf (e->seq, "Esc %c", c);
+      if (c < 0x30)
+        e->acro = nf_acros[c - 0x20];
+      else if (c >= 0x40 && c < 0x60)
+        e->acro = c1_labels[c - 0x40][0];
+      else
+        e->acro = fp_fs_label (c, &name);
+      e->count = st->esc[i];
+    }
+  return n;
+}
+
+/* Write S as a JSON string. */
+static void
+json_string (FILE *f, const char *s)
+{
+  putc ('"', f);
+  for (; *s; ++s)
+    {
+      if (*s == '"' || *s == '\\')
+        putc ('\\', f);
+      putc (*s, f);
+    }
+  putc ('"', f);
+}
+
+static void
+print_entries (FILE *f, int json, const char *title,
+               struct entry *entries, size_t n)
+{
+  size_t i;
+
+  qsort (entries, n, sizeof *entries, compare_entries);
+  if (json)
+    {
+      fprintf (f, ",\n  ");
+      json_string (f, title);
+      fprintf (f, ": [");
+    }
+  else
+    fprintf (f, "%s\n", title);
+  for (i = 0; i != n; ++i)
+    {
+      const char *acro = entries[i].acro ? entries[i].acro : "";
+      if (json)
+        {
+          fprintf (f, "%s\n    {\"sequence\": ", i ? "," : "");
+          json_string (f, entries[i].seq);
+          fprintf (f, ", \"acronym\": ");
+          json_string (f, acro);
+          fprintf (f, ", \"count\": %ju}", entries[i].count);
+        }
+      else
+        fprintf (f, "  %-12s %-8s %20ju\n", entries[i].seq, acro,
+                 entries[i].count);
+    }
+  if (json)
+    fprintf (f, "%s]", n ? "\n  " : "");
+}
+
+/* Print a histogram of COUNTS (N of them), leaving out zeroes. If
+   PLUS is set, the last bucket holds every value from N-1 up. */
+static void
+print_histogram (FILE *f, int json, const char *title,
+                 const uintmax_t *counts, size_t n, int plus)
+{
+  size_t i;
+  int first = 1;
+
+  if (json)
+    {
+      fprintf (f, ",\n  ");
+      json_string (f, title);
+      fprintf (f, ": {");
+    }
+  else
+    fprintf (f, "%s\n", title);
+  for (i = 0; i != n; ++i)
+    {
+      char label[24];
+      if (!counts[i])
+        continue;
+      sprintf (label, "%lu%s", (unsigned long) i,
+               (plus && i == n - 1) ? "+" : "");
+      if (json)
+        fprintf (f, "%s\n    \"%s\": %ju", first ? "" : ",", label,
+                 counts[i]);
+      else
+        fprintf (f, "  %-21s %20ju\n", label, counts[i]);
+      first = 0;
+    }
+  if (json)
+    fprintf (f, "%s}", first ? "" : "\n  ");
+}
+
+/* Print the statistics to F, as a table or (if JSON is set) as a
+   JSON object. Returns 0 on success, or -1 on a write error. */
+int
+stats_print (struct stats *st, FILE *f, int json)
+{
+  struct entry *entries;
+  uintmax_t controls = 0;
+  double mean;
+  size_t i, n;
+
+  entries = malloc (7 * 17 * 0x3f * sizeof *entries);
+  if (!entries)
+    return -1;
+  for (i = 0; i != N_ARY_ELEMS (st->control); ++i)
+    controls += st->control[i];
+  mean = st->sequences ? (double) (st->csi_bytes + st->esc_bytes)
+                         / st->sequences : 0.0;
+
+  if (json)
+    fprintf (f, "{\n  \"bytes\": {\"text\": %ju, \"controls\": %ju,"
+             " \"8bit\": %ju, \"csi\": %ju, \"escape\": %ju},\n"
+             "  \"sequences\": {\"count\": %ju, \"mean_length\": %.2f,"
+             " \"longest\": %ju},\n  \"controls\": {",
+             st->text, controls, st->high, st->csi_bytes, st->esc_bytes,
+             st->sequences, mean, st->longest);
+  else
+    fprintf (f, "Bytes\n"
+             "  text                  %20ju\n"
+             "  controls              %20ju\n"
+             "  8-bit                 %20ju\n"
+             "  control sequences     %20ju\n"
+             "  other escapes         %20ju\n"
+             "Sequences               %20ju\n"
+             "  mean length           %20.2f\n"
+             "  longest               %20ju\n"
+             "Controls\n",
+             st->text, controls, st->high, st->csi_bytes, st->esc_bytes,
+             st->sequences, mean, st->longest);
+  for (i = 0, n = 0; i != N_ARY_ELEMS (st->control); ++i)
+    {
+      const char *name = i < 0x20 ? control_names[i] : "DEL";
+      if (!st->control[i])
+        continue;
+      if (json)
+        fprintf (f, "%s\n    \"%s\": %ju", n ? "," : "", name,
+                 st->control[i]);
+      else
+        fprintf (f, "  %-21s %20ju\n", name, st->control[i]);
+      ++n;
+    }
+  if (json)
+    fprintf (f, "%s}", n ? "\n  " : "");
+
+  print_entries (f, json, json ? "csi" : "Control sequences", entries,
+                 csi_entries (st, entries));
+  print_entries (f, json, json ? "escapes" : "Escape sequences", entries,
+                 esc_entries (st, entries));
+  print_histogram (f, json, json ? "csi_params" : "Parameters per sequence",
+                   st->n_params, N_ARY_ELEMS (st->n_params), 1);
+  print_histogram (f, json, json ? "sgr_params" : "SGR parameters",
+                   st->sgr, N_ARY_ELEMS (st->sgr), 1);
+  if (json)
+    fprintf (f, "\n}\n");
+
+  free (entries);
+  return ferror (f) ? -1 : 0;
+}
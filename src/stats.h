@@ -0,0 +1,91 @@
+/* stats.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Statistics.
+
+    Counts the bytes and control functions seen in the input, for
+    --stats. Every counter lives in a fixed array, indexed directly by
+    the bytes that identify it, so that counting costs no more than an
+    increment. The counters for single bytes are updated by the caller,
+    with STATS_BYTE; escape and control sequences are counted with
+    stats_csi and stats_escape.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "teseq.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Parameter counts above this are counted together. */
+#define STATS_MAX_PARAMS        16
+
+struct stats
+{
+  uintmax_t text;               /* Bytes 0x20-0x7e. */
+  uintmax_t high;               /* Bytes 0x80-0xff. */
+  uintmax_t control[0x21];      /* By C0 code, with DEL last. */
+  uintmax_t csi_bytes;
+  uintmax_t esc_bytes;
+  uintmax_t sequences;
+  uintmax_t longest;
+
+  /* Control sequences, by private-parameter indicator (none, or
+     0x3a-0x3f), intermediate byte (none, or 0x20-0x2f), and final
+     byte (0x40-0x7e). */
+  uintmax_t csi[7][17][0x3f];
+  /* Other escape sequences, by the byte following Esc (0x20-0x7e). */
+  uintmax_t esc[0x5f];
+
+  uintmax_t n_params[STATS_MAX_PARAMS + 1];
+  uintmax_t sgr[256];           /* SGR parameter values; 255 and
+                                   above are counted together. */
+  int in_csi;
+};
+
+#define STATS_BYTE(st, c)                       \
+  do                                            \
+    {                                           \
+      if ((c) >= 0x20 && (c) < 0x7f)            \
+        ++(st)->text;                           \
+      else if ((c) < 0x20)                      \
+        ++(st)->control[c];                     \
+      else if ((c) == 0x7f)                     \
+        ++(st)->control[0x20];                  \
+      else                                      \
+        ++(st)->high;                           \
+    }                                           \
+  while (0)
+
+struct stats *stats_new (void);
+void stats_delete (struct stats *);
+
+void stats_csi (struct stats *, unsigned char private_indicator,
+                unsigned char interm, unsigned char final,
+                size_t n_params, const unsigned int params[]);
+void stats_escape (struct stats *, unsigned char, size_t len);
+
+int stats_print (struct stats *, FILE *, int json);
+
+#endif
@@ -0,0 +1,169 @@
+/* teseq-index.c: search the full-text indexes written by teseq. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "teseq.h"
+
+#include <errno.h>
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "index.h"
+
+const char *program_name;
+
+void
+usage (int status)
+{
+  FILE *f = status == EXIT_SUCCESS ? stdout : stderr;
+  fputs ("\
+Usage: teseq-index QUERY INDEX...\n\
+   or: teseq-index -h | --help\n\
+   or: teseq-index -V | --version\n\
+Search indexes written by teseq --index for lines that contain\n\
+every term in QUERY.\n", f);
+  putc ('\n', f);
+  fputs ("\
+ -h, --help      Display usage information (this message).\n\
+ -V, --version   Display version and warrantee.\n", f);
+  putc ('\n', f);
+  fputs ("\
+For each matching line, the name of the index, the input offset and\n\
+the time (in seconds) at which the line appeared are written out,\n\
+separated by tabs.\n", f);
+  putc ('\n', f);
+  fputs ("\
+The GNU Teseq home page is at http://www.gnu.org/software/teseq/.\n\
+Report all bugs to " PACKAGE_BUGREPORT "\n\
+", f);
+  exit (status);
+}
+
+void
+version (void)
+{
+  puts ("teseq-index (" PACKAGE_NAME ") " PACKAGE_VERSION);
+  puts ("\
+Copyright (C) 2008,2013 Micah Cowan <micah@addictivecode.org>.\n\
+License GPLv3+: GNU GPL version 3 or later \
+<http://gnu.org/licenses/gpl.html>\n\
+This is free software: you are free to change and redistribute it.\n\
+There is NO WARRANTY, to the extent permitted by law.\
+");
+  exit (EXIT_SUCCESS);
+}
+
+#ifdef HAVE_GETOPT_H
+struct option index_opts[] = {
+  { "help", 0, NULL, 'h' },
+  { "version", 0, NULL, 'V' },
+  { 0 }
+};
+#endif
+
+void
+print_hit (off_t offset, double time, void *arg)
+{
+  const char *fname = arg;
+  printf ("%s\t%jd\t%f\n", fname, (intmax_t) offset, time);
+}
+
+/* Search the index in FNAME. Returns 0 on success, or -1 on error
+   (which has been reported). */
+int
+search (const char *query, const char *fname)
+{
+  FILE *f = fopen (fname, "rb");
+  struct index_reader *r;
+  int ret;
+
+  if (!f)
+    {
+      fprintf (stderr, "%s: couldn't open file %s: %s\n", program_name,
+               fname, strerror (errno));
+      return -1;
+    }
+  r = index_read (f);
+  fclose (f);
+  if (!r)
+    {
+      fprintf (stderr, "%s: %s: %s\n", program_name, fname,
+               errno ? strerror (errno) : "not a valid index");
+      return -1;
+    }
+  ret = index_search (r, query, print_hit, (void *)fname);
+  if (ret != 0)
+    fprintf (stderr, "%s: %s: %s\n", program_name, fname,
+             errno ? strerror (errno) : "not a valid index");
+  index_reader_delete (r);
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  int opt, which;
+  int status = EXIT_SUCCESS;
+  const char *query;
+
+  program_name = argv[0];
+  while ((opt = (
+#ifdef HAVE_GETOPT_H
+                 getopt_long (argc, argv, "hV", index_opts, &which)
+#else
+                 getopt (argc, argv, "hV")
+#endif
+                 ))
+         != -1)
+    {
+      switch (opt)
+        {
+        case 'h':
+          usage (EXIT_SUCCESS);
+          break;
+        case 'V':
+          version ();
+          break;
+        default:
+          putc ('\n', stderr);
+          usage (EXIT_FAILURE);
+          break;
+        }
+    }
+  if (argc - optind < 2)
+    usage (EXIT_FAILURE);
+  query = argv[optind++];
+  for (; optind != argc; ++optind)
+    if (search (query, argv[optind]) != 0)
+      status = EXIT_FAILURE;
+  if (fflush (stdout) != 0 || ferror (stdout))
+    {
+      fprintf (stderr, "%s: %s: %s\n", program_name, "write error",
+               strerror (errno));
+      status = EXIT_FAILURE;
+    }
+  return status;
+}
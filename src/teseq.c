@@ -22,12 +22,13 @@
 #include "teseq.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #ifdef HAVE_GETOPT_H
 #  include <getopt.h>
 #endif
 #include <limits.h>
-#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,11 +36,24 @@
 #  include <strings.h>
 #endif
 #include <sys/stat.h>
-#include <termios.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "batch.h"
+#include "checkpoint.h"
+#include "child.h"
+#include "compress.h"
+#include "decompress.h"
+#include "follow.h"
+#include "index.h"
 #include "inputbuf.h"
+#include "instr.h"
+#include "passthrough.h"
 #include "putter.h"
+#include "screen.h"
+#include "server.h"
+#include "stats.h"
+#include "tty.h"
 
 /* label/description maps. */
 #include "csi.h"
@@ -78,15 +92,53 @@ enum processor_state
 
 struct processor
 {
+  struct arena *arena;          /* Where the buffers are kept. */
+  const struct config *cfg;
   struct inputbuf *ibuf;
   struct putter *putr;
   enum processor_state st;
   int print_dot;
   size_t mark;
   size_t next_mark;
-  
+  struct screen *screen;
+  double screen_delay;          /* Delay not yet written out, in
+                                   screen mode. */
+  int screen_delay_pending;
+  double elapsed;               /* Total delay so far. */
+  unsigned long snap_seen;      /* Screen epoch of the last snapshot. */
+  unsigned long snap_count;
+  off_t snap_next_offset;
+  double snap_next_time;
+  int delay_started;            /* The first delay has been skipped. */
+  FILE *timings;                /* NULL once all have been read. */
+  int in_header;                /* Reading the typescript's timestamp
+                                   line, which comes before the first
+                                   delay. */
+  off_t resumed_at;             /* Where reading the input began, with
+                                   --checkpoint. */
+  FILE *inf;
+  FILE *outf;
+  struct index *index;
+  int shown;                    /* The last escape sequence was
+                                   selected by --only. */
+  struct stats *stats;
+  putter_error_handler handler; /* Called on write errors. */
+  void *handler_arg;
 };
 
+/* The longest escape sequence we'll look ahead through, unless a
+   longer one is allowed with --max-lookahead; the input buffer only
+   grows past this for such a sequence. */
+#define LOOKAHEAD_SIZE  1024
+
+/* Room enough in a processor's arena for the processor, its input
+   buffer and its putter, with space for the putter to format in. */
+#define ARENA_SIZE      (LOOKAHEAD_SIZE + 1024)
+
+/* The narrowest output --width allows: room for a continuation line's
+   markers, with some text between them. */
+#define WIDTH_MIN       10
+
 struct delay
 {
   double time;
@@ -106,18 +158,33 @@ const char *control_names[] = {
 
 static const char default_color_string[] = "|>=36;7,.=31,:=33,&=35,\"=32,@=34";
 
-struct sgr_def    sgr_text, sgr_text_decor, sgr_ctrl, sgr_esc,
-                  sgr_label, sgr_desc, sgr_delay;
-
-struct config configuration = { 0 };
 const char *program_name;
 
-static struct termios saved_stty;
-static struct termios working_stty;
-static int input_term_fd = -1;
-static int output_tty_p = 0;
-static volatile sig_atomic_t signal_pending_p;
-static int pending_signal;
+/* Whether P's --only filter selects an event. When the filter isn't
+   active, every event is selected. */
+#define ONLY(p)         (&(p)->cfg->only)
+#define SHOW_TEXT       (!ONLY (p)->active || ONLY (p)->text)
+#define SHOW_DELAY      (!ONLY (p)->active || ONLY (p)->delays)
+#define SHOW_CONTROL(c) (!ONLY (p)->active || ONLY (p)->all_controls \
+                         || ((c) < 0x20 && ONLY (p)->controls[c]) \
+                         || ((c) == C_DEL && ONLY (p)->controls[0x20]))
+#define SHOW_CSI(acro)  (!ONLY (p)->active || ONLY (p)->all_csi \
+                         || only_has (ONLY (p)->csi, ONLY (p)->n_csi, (acro)))
+#define SHOW_ESC(acro)  (!ONLY (p)->active || ONLY (p)->all_esc \
+                         || only_has (ONLY (p)->esc, ONLY (p)->n_esc, (acro)))
+
+static int
+only_has (const char **names, size_t n, const char *acro)
+{
+  size_t i;
+
+  if (!acro)
+    return 0;
+  for (i = 0; i != n; ++i)
+    if (strcmp (names[i], acro) == 0)
+      return 1;
+  return 0;
+}
 
 
 #define is_normal_text(x)       ((x) >= 0x20 && (x) < 0x7f)
@@ -133,8 +200,9 @@ handle_write_error (int e, void *arg)
   exit (e);
 }
 
-/* Read a line from a typescript timings file. */
-void
+/* Read a line from a typescript timings file. Returns 0 on success,
+   or -1 at the end of the file. */
+int
 delay_read (FILE *f, struct delay *d)
 {
   double time;
@@ -146,13 +214,11 @@ delay_read (FILE *f, struct delay *d)
     {
       d->time = 0.0;
       d->chars = 0;
-      configuration.timings = NULL;
-    }
-  else
-    {
-      d->time = time;
-      d->chars = chars;
+      return -1;
     }
+  d->time = time;
+  d->chars = chars;
+  return 0;
 }
 
 void
@@ -164,15 +230,18 @@ print_esc_char (struct processor *p, unsigned char c)
       putter_puts (p->putr, " Spc");
     else
       {
+        char tok[2];
         assert(c > 0x20 && c < 0x7f);
-        putter_printf (p->putr, " %c", c);
+        tok[0] = ' ';
+        tok[1] = c;
+        putter_putn (p->putr, tok, 2);
       }
 }
 
 void
 maybe_print_label (struct processor *p, const char *acro, const char *name)
 {
-  if (configuration.labels)
+  if (p->cfg->labels)
     putter_single_label (p->putr, "%s: %s", acro, name);
 }
 
@@ -220,23 +289,26 @@ void
 process_csi_sequence (struct processor *p, const struct csi_handler *handler)
 {
   int c;
-  int e = configuration.escapes;
+  int e = p->cfg->escapes;
   int private_params = 0;
   int last = 0;
+  int interm = 0;
   size_t n_params = 0;
 
   size_t cur_param = 0;
   unsigned int params[255];
 
+  p->shown = SHOW_CSI (handler->acro);
+  e = e && p->shown;
   if (e)
-    putter_start (p->putr, &sgr_esc, NULL, ":", "", ": ");
+    putter_start (p->putr, &p->cfg->colors.esc, NULL, ":", "", ": ");
   
   if (e)
     putter_puts (p->putr, " Esc");
   c = inputbuf_get (p->ibuf);
   assert (c == '[');
   if (e)
-    putter_printf (p->putr, " [", c);
+    putter_puts (p->putr, " [");
   c = inputbuf_get (p->ibuf);
   if (!IS_CSI_FINAL_CHAR (c))
     {
@@ -267,7 +339,7 @@ process_csi_sequence (struct processor *p, const struct csi_handler *handler)
               if (n_params < N_ARY_ELEMS (params))
                 params[n_params++] = cur_param;
               if (e)
-                putter_printf (p->putr, " %d", cur_param);
+                putter_put_uint (p->putr, " ", cur_param);
             }
           else if ((last != 0 || private_params == 0)
                    && ! IS_CSI_INTERMEDIATE_CHAR (last)
@@ -281,6 +353,8 @@ process_csi_sequence (struct processor *p, const struct csi_handler *handler)
                 }
             }
 
+          if (IS_CSI_INTERMEDIATE_CHAR (c))
+            interm = c;
           if (e)
             print_esc_char (p, c);
         }
@@ -290,10 +364,14 @@ process_csi_sequence (struct processor *p, const struct csi_handler *handler)
     }
   if (e)
     putter_finish (p->putr, "");
-  if (configuration.labels)
+  if (p->cfg->labels && p->shown)
     print_csi_label (p, handler, private_params);
+  if (p->screen)
+    screen_csi (p->screen, c, private_params, interm, n_params, params);
+  if (p->stats)
+    stats_csi (p->stats, private_params, interm, c, n_params, params);
 
-  if (configuration.descriptions && handler->fn)
+  if (p->cfg->descriptions && p->shown && handler->fn)
     {
       int wrong_num_params = 0;
       init_csi_params (handler, &n_params, params);
@@ -619,9 +697,13 @@ static const char * const iso_ir_names[] =
     /* 234 */ "SI1311:2002"
   };
 
-/* Return the name of a character set, given its ISO-IR registry number.  */
+/* Enough room for the names iso_ir_name makes up. */
+#define ISO_IR_NAME_MAX 20
+
+/* Return the name of a character set, given its ISO-IR registry
+   number. Names for unlisted numbers are made up in BUF.  */
 static const char *
-iso_ir_name (float id)
+iso_ir_name (float id, char *buf)
 {
   if (id == 8.1)
     return "NATS-SEFI";
@@ -639,7 +721,6 @@ iso_ir_name (float id)
 	name = iso_ir_names[i];
       if (name == NULL)
 	{
-	  static char buf[20];
 	  sprintf (buf, "ISO-IR-%d", i);
 	  name = buf;
 	}
@@ -660,12 +741,12 @@ static float const iso_ir_table1[] =
 
 /* Return the name of a character set, given the final byte
    of the 3-byte escape sequence ESC 0x28..0x2B 0x40+XX.
-   Return NULL if unknown.  */
+   Return NULL if unknown. BUF is as for iso_ir_name.  */
 static const char *
-iso_ir_table1_name (int f)
+iso_ir_table1_name (int f, char *buf)
 {
   if (f >= 0x40 && f < 0x40 + sizeof (iso_ir_table1) / sizeof (iso_ir_table1[0]))
-    return iso_ir_name (iso_ir_table1[f - 0x40]);
+    return iso_ir_name (iso_ir_table1[f - 0x40], buf);
   else
     return NULL;
 }
@@ -680,12 +761,12 @@ static int const iso_ir_table2[] =
 
 /* Return the name of a character set, given the final byte
    of the 4-byte escape sequence ESC 0x28..0x2B 0x21 0x40+XX.
-   Return NULL if unknown.  */
+   Return NULL if unknown. BUF is as for iso_ir_name.  */
 static const char *
-iso_ir_table2_name (int f)
+iso_ir_table2_name (int f, char *buf)
 {
   if (f >= 0x40 && f < 0x40 + sizeof (iso_ir_table2) / sizeof (iso_ir_table2[0]))
-    return iso_ir_name (iso_ir_table2[f - 0x40]);
+    return iso_ir_name (iso_ir_table2[f - 0x40], buf);
   else
     return NULL;
 }
@@ -703,15 +784,15 @@ static int const iso_ir_table3[] =
 
 /* Return the name of a character set, given the final byte
    of the 3-byte escape sequence ESC 0x2D..0x2F 0x40+XX.
-   Return NULL if unknown.  */
+   Return NULL if unknown. BUF is as for iso_ir_name.  */
 static const char *
-iso_ir_table3_name (int f)
+iso_ir_table3_name (int f, char *buf)
 {
   if (f >= 0x40 && f < 0x40 + sizeof (iso_ir_table3) / sizeof (iso_ir_table3[0]))
     {
       int id = iso_ir_table3[f - 0x40];
       if (id >= 0)
-        return iso_ir_name (id);
+        return iso_ir_name (id, buf);
     }
   return NULL;
 }
@@ -729,12 +810,12 @@ static int const iso_ir_table4[] =
 /* Return the name of a character set, given the final byte
    of the escape sequence ESC 0x24 [0x28] 0x40+XX (the 0x28 can be omitted only
    for the first three) or ESC 0x24 0x29..0x2B 0x40+XX.
-   Return NULL if unknown.  */
+   Return NULL if unknown. BUF is as for iso_ir_name.  */
 static const char *
-iso_ir_table4_name (int f)
+iso_ir_table4_name (int f, char *buf)
 {
-  if (f >= 0x40 && f < 0x40 + sizeof (iso_ir_table3) / sizeof (iso_ir_table3[0]))
-    return iso_ir_name (iso_ir_table4[f - 0x40]);
+  if (f >= 0x40 && f < 0x40 + sizeof (iso_ir_table4) / sizeof (iso_ir_table4[0]))
+    return iso_ir_name (iso_ir_table4[f - 0x40], buf);
   else
     return NULL;
 }
@@ -940,7 +1021,7 @@ print_cxd_info (struct processor *p, int intermediate, int final)
   if (intermediate == 0x21)
     {
       maybe_print_label (p, "CZD", "C0-DESIGNATE");
-      if (configuration.descriptions)
+      if (p->cfg->descriptions)
 	{
 	  const char *name = iso_ir_c0_name (final);
 	  if (name != NULL)
@@ -951,7 +1032,7 @@ print_cxd_info (struct processor *p, int intermediate, int final)
   else
     {
       maybe_print_label (p, "C1D", "C1-DESIGNATE");
-      if (configuration.descriptions)
+      if (p->cfg->descriptions)
 	{
 	  const char *name = iso_ir_c1_name (final);
 	  if (name != NULL)
@@ -984,42 +1065,41 @@ print_gxd_info (struct processor *p, int intermediate, int i1, int final)
   else
     return;
 
-  if (configuration.labels)
+  if (p->cfg->labels)
     {
       putter_single_label (p->putr, "G%cD%d: G%d-DESIGNATE 9%d-SET",
                            desig_strs[designate], set, designate, set);
     }
-  if (configuration.descriptions)
+  if (p->cfg->descriptions)
     {
-      const char *designator;
       const char *explanation;
+      char designator[3];
+      char namebuf[ISO_IR_NAME_MAX];
+      char buf[100];
 
       {
-	static char buf[10];
-	char *p = buf;
+	char *p = designator;
 
 	if (i1 != 0)
 	  *p++ = i1;
 	*p++ = final;
 	*p = '\0';
-	designator = buf;
       }
 
       if (GET_COLUMN (final) == 3)
 	explanation = " (private)";
       else
 	{
-	  static char buf[100];
 	  const char *name;
 
 	  if (set == 4)
 	    {
 	      if (i1 == 0)
 		/* ESC 0x28..0x2B FINAL */
-		name = iso_ir_table1_name (final);
+		name = iso_ir_table1_name (final, namebuf);
 	      else if (i1 == 0x21)
 		/* ESC 0x28..0x2B 0x21 FINAL */
-		name = iso_ir_table2_name (final);
+		name = iso_ir_table2_name (final, namebuf);
 	      else
 		name = NULL;
 	    }
@@ -1027,7 +1107,7 @@ print_gxd_info (struct processor *p, int intermediate, int i1, int final)
 	    {
 	      if (i1 == 0)
 		/* ESC 0x2D..0x2F FINAL */
-		name = iso_ir_table3_name (final);
+		name = iso_ir_table3_name (final, namebuf);
 	      else
 		name = NULL;
 	    }
@@ -1076,23 +1156,24 @@ print_gxdm_info (struct processor *p, int i1, int final)
 
   assert (designate >= 0);
   assert (designate < 4);
-  if (configuration.labels)
+  if (p->cfg->labels)
     {
       putter_single_label (p->putr, "G%cDM%d: G%d-DESIGNATE MULTIBYTE 9%d-SET",
                            desig_strs[designate], set, designate, set);
     }
-  if (configuration.descriptions)
+  if (p->cfg->descriptions)
     {
       const char *explanation;
+      char namebuf[ISO_IR_NAME_MAX];
+      char buf[100];
 
       if (GET_COLUMN (final) == 3)
 	explanation = " (private)";
       else
 	{
-	  static char buf[100];
 	  const char *name;
 
-	  name = (set == 4 ? iso_ir_table4_name (final) : NULL);
+	  name = (set == 4 ? iso_ir_table4_name (final, namebuf) : NULL);
 	  if (name != NULL)
 	    {
 	      sprintf (buf, " (%s)", name);
@@ -1139,11 +1220,13 @@ handle_nF (struct processor *p, unsigned char i)
   else if (! IS_nF_FINAL_CHAR (f))
     return 0;
   
-  if (configuration.escapes)
+  /* Designations aren't selected by name. */
+  p->shown = SHOW_ESC (NULL);
+  if (p->cfg->escapes && p->shown)
     {
       inputbuf_rewind (p->ibuf);
 
-      putter_start (p->putr, &sgr_esc, NULL, ":", "", ": ");
+      putter_start (p->putr, &p->cfg->colors.esc, NULL, ":", "", ": ");
       print_esc_char (p, C_ESC);
       do
         {
@@ -1155,7 +1238,7 @@ handle_nF (struct processor *p, unsigned char i)
       putter_finish (p->putr, "");
     }
 
-  if (! IS_nF_FINAL_CHAR (f))
+  if (! IS_nF_FINAL_CHAR (f) || !p->shown)
     return 1;
 
   if (i == 0x20)
@@ -1185,7 +1268,12 @@ handle_c1 (struct processor *p, unsigned char c)
   if (c == '[')
     {
       const struct csi_handler *h;
-      if ((h = read_csi_sequence (p)))
+      INSTR_DECL (t);
+
+      INSTR_START (t);
+      h = read_csi_sequence (p);
+      INSTR_STOP (t, INSTR_CSI, 0);
+      if (h)
         {
           process_csi_sequence (p, h);
           return 1;
@@ -1197,87 +1285,97 @@ handle_c1 (struct processor *p, unsigned char c)
         }
     }
 
-  if (configuration.escapes)
+  p->shown = SHOW_ESC (c1_labels[c - 0x40][0]);
+  if (p->cfg->escapes && p->shown)
     putter_single_esc (p->putr, "Esc %c", c);
-  if (configuration.labels)
+  if (p->cfg->labels && p->shown)
     print_c1_label (p, c);
+  if (p->screen)
+    screen_esc (p->screen, c);
   return 1;
 }
 
-/*
-  handle_Fp: private function escape sequence, in the format "Esc Fp",
-  where Fp is a byte in the 0x30-0x3f range.
-
-  Among common uses for this sequence is the "keypad application mode",
-  which VT100-style terminals use to change the key sequences generated by
-  keys from the keypad; and "save/restore cursor".
-*/
-int
-handle_Fp (struct processor *p, unsigned char c)
+/* Find the acronym and name of the function invoked by Esc Fp (a byte
+   in the 0x30-0x3f range) or Esc Fs (0x60-0x7e). Returns NULL if
+   there's none we know of. */
+const char *
+fp_fs_label (unsigned char c, const char **name)
 {
-  if (configuration.escapes)
-    putter_single_esc (p->putr, "Esc %c", c);
+  const char *acro = NULL;
+
   switch (c)
     {
     case '7':
-      maybe_print_label (p, "DECSC", "SAVE CURSOR");
+      acro = "DECSC"; *name = "SAVE CURSOR";
       break;
     case '8':
-      maybe_print_label (p, "DECRC", "RESTORE CURSOR");
+      acro = "DECRC"; *name = "RESTORE CURSOR";
       break;
     case '=':
-      maybe_print_label (p, "DECKPAM", "KEYPAD APPLICATION MODE");
+      acro = "DECKPAM"; *name = "KEYPAD APPLICATION MODE";
       break;
     case '>':
-      maybe_print_label (p, "DECKPNM", "KEYPAD NORMAL MODE");
+      acro = "DECKPNM"; *name = "KEYPAD NORMAL MODE";
       break;
-    }
-  return 1;
-}
-
-/*
-  handle_Fs: Standardized single function control, in the format "Esc Fs",
-  where Fs is a byte in the 0x60-0x7e range, and designates a control
-  function registered with ISO.
-*/
-int
-handle_Fs (struct processor *p, unsigned char c)
-{
-  if (configuration.escapes)
-    putter_single_esc (p->putr, "Esc %c", c);
-  switch (c)
-    {
     case 0x60:
-      maybe_print_label (p, "DMI", "DISABLE MANUAL INPUT");
+      acro = "DMI"; *name = "DISABLE MANUAL INPUT";
       break;
     case 0x61:
-      maybe_print_label (p, "INT", "INTERRUPT");
+      acro = "INT"; *name = "INTERRUPT";
       break;
     case 0x62:
-      maybe_print_label (p, "EMI", "END OF MEDIUM");
+      acro = "EMI"; *name = "END OF MEDIUM";
       break;
     case 0x63:
-      maybe_print_label (p, "RIS", "RESET TO INITIAL STATE");
+      acro = "RIS"; *name = "RESET TO INITIAL STATE";
       break;
     case 0x64:
-      maybe_print_label (p, "CMD", "CODING METHOD DELIMITER");
+      acro = "CMD"; *name = "CODING METHOD DELIMITER";
       break;
     case 0x6e:
-      maybe_print_label (p, "LS2", "LOCKING-SHIFT TWO");
+      acro = "LS2"; *name = "LOCKING-SHIFT TWO";
       break;
     case 0x6f:
-      maybe_print_label (p, "LS3", "LOCKING-SHIFT THREE");
+      acro = "LS3"; *name = "LOCKING-SHIFT THREE";
       break;
     case 0x7c:
-      maybe_print_label (p, "LS3R", "LOCKING-SHIFT THREE RIGHT ");
+      acro = "LS3R"; *name = "LOCKING-SHIFT THREE RIGHT ";
       break;
     case 0x7d:
-      maybe_print_label (p, "LS2R", "LOCKING-SHIFT TWO RIGHT ");
+      acro = "LS2R"; *name = "LOCKING-SHIFT TWO RIGHT ";
       break;
     case 0x7e:
-      maybe_print_label (p, "LS1R", "LOCKING-SHIFT ONE RIGHT ");
+      acro = "LS1R"; *name = "LOCKING-SHIFT ONE RIGHT ";
       break;
     }
+  return acro;
+}
+
+/*
+  handle_Fp: private function escape sequence, in the format "Esc Fp",
+  where Fp is a byte in the 0x30-0x3f range.
+
+  Among common uses for this sequence is the "keypad application mode",
+  which VT100-style terminals use to change the key sequences generated by
+  keys from the keypad; and "save/restore cursor".
+
+  handle_Fs: Standardized single function control, in the format "Esc Fs",
+  where Fs is a byte in the 0x60-0x7e range, and designates a control
+  function registered with ISO.
+*/
+int
+handle_Fp_Fs (struct processor *p, unsigned char c)
+{
+  const char *name = NULL;
+  const char *acro = fp_fs_label (c, &name);
+
+  p->shown = SHOW_ESC (acro);
+  if (p->cfg->escapes && p->shown)
+    putter_single_esc (p->putr, "Esc %c", c);
+  if (p->screen)
+    screen_esc (p->screen, c);
+  if (acro && p->shown)
+    maybe_print_label (p, acro, name);
   return 1;
 }
 
@@ -1286,7 +1384,10 @@ handle_escape_sequence (struct processor *p)
 {
   int c;
   int handled = 0;
+  off_t start = 0;
 
+  if (p->stats)
+    start = inputbuf_get_offset (p->ibuf);
   inputbuf_saving (p->ibuf);
 
   c = inputbuf_get (p->ibuf);
@@ -1298,7 +1399,7 @@ handle_escape_sequence (struct processor *p)
         handled = handle_nF (p, c);
         break;
       case 3:
-        handled = handle_Fp (p, c);
+        handled = handle_Fp_Fs (p, c);
         break;
       case 4:
       case 5:
@@ -1307,14 +1408,20 @@ handle_escape_sequence (struct processor *p)
       case 6:
       case 7:
         if (c != C_DEL)
-          handled = handle_Fs (p, c);
+          handled = handle_Fp_Fs (p, c);
         break;
       }
 
   if (handled)
     {
       inputbuf_forget (p->ibuf);
-      p->print_dot = 1;
+      /* Start a new control line after this, unless it was left out
+         (by --only), and there's nothing to separate. */
+      if (p->shown)
+        p->print_dot = 1;
+      if (p->stats)
+        stats_escape (p->stats, c,
+                      inputbuf_get_offset (p->ibuf) - start + 1);
     }
   else
     inputbuf_rewind (p->ibuf);
@@ -1325,24 +1432,35 @@ handle_escape_sequence (struct processor *p)
 int
 print_control (struct processor *p, unsigned char c)
 {
+  p->st = ST_CTRL;
+  if (!SHOW_CONTROL (c))
+    return 0;
   if (p->print_dot)
     {
       p->print_dot = 0;
-      putter_start (p->putr, &sgr_ctrl, NULL, ".", "", ".");
+      putter_start (p->putr, &p->cfg->colors.ctrl, NULL, ".", "", ".");
     }
   if (IS_CONTROL (c) || c == C_DEL)
     {
       const char *name = "DEL";
+      char tok[8];
+      size_t len;
+
       if (c < 0x20)
         name = control_names[c];
-      if (configuration.control_hats)
-        putter_printf (p->putr, " %s/^%c", name, UNCONTROL (c));
-      else
-        putter_printf (p->putr, " %s", name);
+      len = strlen (name);
+      tok[0] = ' ';
+      memcpy (tok + 1, name, len++);
+      if (p->cfg->control_hats)
+        {
+          tok[len++] = '/';
+          tok[len++] = '^';
+          tok[len++] = UNCONTROL (c);
+        }
+      putter_putn (p->putr, tok, len);
     }
   else
-    putter_printf (p->putr, " x%02X", (unsigned int) c);
-  p->st = ST_CTRL;
+    putter_put_hex (p->putr, " x", c);
   return 0;
 }
 
@@ -1356,7 +1474,10 @@ init_state (struct processor *p, unsigned char c)
     }
   else
     {
-      putter_start (p->putr, &sgr_text, &sgr_text_decor, "|", "|-", "-|");
+      if (SHOW_TEXT)
+        putter_start (p->putr, &p->cfg->colors.text,
+                      &p->cfg->colors.text_decor,
+                      "|", "|-", "-|");
       p->st = ST_TEXT;
     }
 }
@@ -1382,46 +1503,42 @@ finish_state (struct processor *p)
   p->st = ST_INIT;
 }
 
-void
-catchsig (int s)
-{
-  if (!signal_pending_p)
-    {
-      pending_signal = s;
-      signal_pending_p = 1;
-    }
-}
-
+/* If a signal is waiting, and there's no input waiting to be
+   processed first, finish the current line (if the user can see it)
+   and let the signal take effect. */
 void
 handle_pending_signal (struct processor *p)
 {
-  struct sigaction sa;
   if (!signal_pending_p || inputbuf_avail (p->ibuf))
     return;
   
-  if (output_tty_p)
+  if (p->cfg->output_tty)
     finish_state (p);
-
-  if (input_term_fd != -1)
-    tcsetattr (input_term_fd, TCSANOW, &saved_stty);
-
-  sigaction (pending_signal, NULL, &sa);
-  sa.sa_handler = SIG_DFL;
-  sigaction (pending_signal, &sa, NULL);
-  raise (pending_signal);
-  sa.sa_handler = catchsig;
-  sigaction (pending_signal, &sa, NULL);
-
-  if (input_term_fd != -1)
-    tcsetattr (input_term_fd, TCSANOW, &working_stty);
-
-  signal_pending_p = 0;
+  signal_raise_pending ();
 }
 
 void
 process (struct processor *p, unsigned char c)
 {
   int handled = 0;
+
+  /* Escape sequences are fed to the screen as they are recognized;
+     everything else, here. */
+  if (p->screen && c != C_ESC)
+    screen_putc (p->screen, c);
+  if (p->stats)
+    {
+      if (c != C_ESC || !handle_escape_sequence (p))
+        STATS_BYTE (p->stats, c);
+      return;
+    }
+  if (p->cfg->screen)
+    {
+      if (c == C_ESC)
+        handle_escape_sequence (p);
+      return;
+    }
+
   while (!handled)
     {
       switch (p->st)
@@ -1443,7 +1560,7 @@ process (struct processor *p, unsigned char c)
               finish_state (p);
               continue;
             }
-          else
+          else if (SHOW_TEXT)
             {
               putter_putc (p->putr, c);
             }
@@ -1468,6 +1585,9 @@ usage (int status)
   FILE *f = status == EXIT_SUCCESS ? stdout : stderr;
   fputs ("\
 Usage: teseq [-CLDEx] [in [out]]\n\
+   or: teseq [-CLDEx] -f INPUT [OUTPUT]\n\
+   or: teseq [-CLDEx] --command [--] COMMAND [ARG]...\n\
+   or: teseq [-CLDEx] --batch -o DIR [FILE]...\n\
    or: teseq -h | --help\n\
    or: teseq -V | --version\n\
 Format text with terminal escapes and control sequences for human\n\
@@ -1490,8 +1610,76 @@ consumption.\n", f);
                  mode, and don't try to ensure output lines are finished\n\
                  when a signal is received.\n\
  -b, --buffered  Force teseq to buffer I/O.\n\
+ -f, --follow    Don't stop at the end of INPUT, but keep decoding what's\n\
+                 added to it, as tail -f does, until interrupted.\n\
  -t, --timings=TIMINGS\n\
                  Read timing info from TIMINGS and emit delay lines.\n\
+     --stats[=FORMAT]\n\
+                 Instead of the usual output, print counts of the text,\n\
+                 controls and escape sequences in the input. FORMAT can\n\
+                 be 'table' (the default) or 'json'.\n\
+     --only=EVENTS\n\
+                 Only print the events in EVENTS, a comma-separated list\n\
+                 of text, delay, control[:NAME], csi[:ACRO] and esc[:ACRO].\n\
+     --screen[=COLSxROWS]\n\
+                 Emulate a terminal of the given size (default 80x24),\n\
+                 and write out what its screen shows, instead of the\n\
+                 usual output. With -t, this is done at each delay.\n\
+     --text      Emulate a terminal, and write out the text of each\n\
+                 line as it leaves its screen, instead of the usual output.\n\
+     --index=FILE\n\
+                 Write a full-text index of the lines of text, as for\n\
+                 --text, to FILE, for searching with teseq-index.\n\
+     --screen-size=COLSxROWS\n\
+                 Set the size of the emulated screen (default 80x24).\n\
+     --snapshot-every=N[s]\n\
+                 Every N bytes of input (or N seconds of delay, with -t\n\
+                 or --timestamp), write the changes to the emulated\n\
+                 screen to the file given by --snapshot-file.\n\
+     --snapshot-file=FILE\n\
+                 Write screen snapshots to FILE.\n\
+     --listen=SOCKET\n\
+                 Instead of reading INPUT, accept connections on the\n\
+                 Unix-domain socket SOCKET, and decode each one as a\n\
+                 separate stream, writing the output back to it.\n\
+     --threads=N\n\
+                 With --listen or --batch, decode with N threads\n\
+                 (default: one per processor).\n\
+     --batch     Decode each FILE (or each file named on a line of the\n\
+                 standard input) to a file in the directory given by -o.\n\
+ -o, --output-dir=DIR\n\
+                 With --batch, write the output for FILE to\n\
+                 DIR/FILE.teseq.\n\
+     --passthrough=FILE\n\
+                 Copy the input unchanged to the standard output, and\n\
+                 write the usual output to FILE instead.\n\
+     --output-compress=FORMAT[:LEVEL]\n\
+                 Compress the output with FORMAT, gzip or zstd, at\n\
+                 the given LEVEL, on a separate thread.\n\
+     --width=WIDTH\n\
+                 Split output lines longer than WIDTH columns. WIDTH\n\
+                 can be a number, 'unlimited', or 'auto' (the default):\n\
+                 two less than the terminal's width, or else 78.\n\
+     --max-lookahead=N\n\
+                 Decode escape sequences of up to N bytes (default\n\
+                 1024), looking ahead through the input that far.\n\
+     --checkpoint=FILE\n\
+                 Leave the output unfinished at the end of INPUT, and\n\
+                 write where it got to in FILE; the next run with the\n\
+                 same FILE carries on from there, appending its output.\n\
+     --pipeline  Read the input, decode it, and write the output, each\n\
+                 on a thread of its own.\n\
+     --timestamp Time the input as it's read, and print delay lines\n\
+                 for the waits between reads, as for -t.\n\
+     --command   Instead of reading INPUT, run COMMAND under a\n\
+                 pseudo-terminal, passing it what's typed, and decode\n\
+                 what it writes.\n\
+     --record=FILE\n\
+                 With --command or --timestamp, write the input to\n\
+                 FILE, as a typescript for use with -t.\n\
+     --record-timings=FILE\n\
+                 With --command or --timestamp, write the timings of\n\
+                 the input to FILE, for use with -t.\n\
  -x              (No effect; accepted for backwards compatibility.)\n", f);
   putc ('\n', f);
   fputs ("\
@@ -1535,71 +1723,7 @@ must_fopen (const char *fname, const char *mode, int dash)
 }
 
 void
-tty_setup (int fd)
-{
-  struct termios ti;
-  int            intr;
-  char          *ctrl_name = NULL;
-
-  if (tcgetattr (fd, &ti) != 0)
-    return;
-  saved_stty = ti;
-  intr = ti.c_cc[VINTR];
-  ti.c_lflag &= ~ICANON;
-  if (output_tty_p)
-    ti.c_lflag &= ~ECHO;
-  working_stty = ti;
-  input_term_fd = fd;
-  tcsetattr (fd, TCSANOW, &ti);
-
-  /* Notify the user that they're in non-canonical mode. */
-
-  fprintf (stderr,
-           "  Terminal detected. Interactive mode (-I option to disable).\n"
-           "  Send the interrupt character to exit.");
-
-  if (IS_CONTROL(intr))
-    {
-      fprintf (stderr, " (Control-%c)",
-               intr + '@');  /* <--- Example: '\003' -> (Control-C) */
-    }
-  else if (intr == C_DEL)
-    {
-      fprintf (stderr, " (DEL, or Control-?)");
-    }
-
-  fputs ("\n\n", stderr);
-}
-
-void
-signal_setup (void)
-{
-  static const int sigs[] =
-    {
-      SIGINT,
-      SIGTERM,
-      SIGTSTP,
-      SIGTTIN,
-      SIGTTOU
-    };
-  const int *sig, *sige = sigs + N_ARY_ELEMS (sigs);
-  struct sigaction sa;
-  sigset_t mask;
-
-  sigemptyset (&mask);
-  for (sig = sigs; sig != sige; ++sig)
-    sigaddset (&mask, *sig);
-  
-  sa.sa_handler = catchsig;
-  sa.sa_mask = mask;
-  sa.sa_flags = 0;
-  
-  for (sig = sigs; sig != sige; ++sig)
-    sigaction (*sig, &sa, NULL);
-}
-
-void
-parse_colors (const char *color_string)
+parse_colors (struct colors *colors, const char *color_string)
 {
   const char *p, *s, *e;
   struct sgr_def *set_me;
@@ -1612,17 +1736,17 @@ parse_colors (const char *color_string)
         case '|':
           if (p[1] == '>')
             {
-              set_me = &sgr_text;
+              set_me = &colors->text;
               ++p;
             }
           else
-            set_me = &sgr_text_decor;
+            set_me = &colors->text_decor;
           break;
-        case '.': set_me = &sgr_ctrl; break;
-        case ':': set_me = &sgr_esc; break;
-        case '&': set_me = &sgr_label; break;
-        case '"': set_me = &sgr_desc; break;
-        case '@': set_me = &sgr_delay; break;
+        case '.': set_me = &colors->ctrl; break;
+        case ':': set_me = &colors->esc; break;
+        case '&': set_me = &colors->label; break;
+        case '"': set_me = &colors->desc; break;
+        case '@': set_me = &colors->delay; break;
         default:
           ; /* Won't set anything, just skip to next one. */
         }
@@ -1655,53 +1779,418 @@ parse_colors (const char *color_string)
 }
 
 void
-color_setup (void)
+color_setup (struct config *cfg)
 {
   const char *envstr = getenv("TESEQ_COLORS");
 
-  if (configuration.color != CFG_COLOR_ALWAYS)
+  if (cfg->color != CFG_COLOR_ALWAYS)
     return;
 
-  parse_colors (default_color_string);
+  parse_colors (&cfg->colors, default_color_string);
   if (envstr)
-    parse_colors (envstr);
+    parse_colors (&cfg->colors, envstr);
+  putter_cache_sgr (&cfg->colors.text);
+  putter_cache_sgr (&cfg->colors.text_decor);
+  putter_cache_sgr (&cfg->colors.ctrl);
+  putter_cache_sgr (&cfg->colors.esc);
+  putter_cache_sgr (&cfg->colors.label);
+  putter_cache_sgr (&cfg->colors.desc);
+  putter_cache_sgr (&cfg->colors.delay);
 }
 
+/* Values for long options that have no short equivalent. */
+enum
+{
+  OPT_SCREEN = UCHAR_MAX + 1,
+  OPT_SCREEN_SIZE,
+  OPT_TEXT,
+  OPT_INDEX,
+  OPT_ONLY,
+  OPT_STATS,
+  OPT_SNAPSHOT_EVERY,
+  OPT_SNAPSHOT_FILE,
+  OPT_LISTEN,
+  OPT_THREADS,
+  OPT_PASSTHROUGH,
+  OPT_COMMAND,
+  OPT_RECORD,
+  OPT_RECORD_TIMINGS,
+  OPT_TIMESTAMP,
+  OPT_OUTPUT_COMPRESS,
+  OPT_PIPELINE,
+  OPT_MAX_LOOKAHEAD,
+  OPT_CHECKPOINT,
+  OPT_BATCH,
+  OPT_WIDTH,
+  OPT_COLOR
+};
+
 #ifdef HAVE_GETOPT_H
 struct option teseq_opts[] = {
   { "help", 0, NULL, 'h' },
   { "version", 0, NULL, 'V' },
   { "timings", 1, NULL, 't' },
   { "buffered", 0, NULL, 'b' },
+  { "follow", 0, NULL, 'f' },
   { "no-interactive", 0, NULL, 'I' },
-  { "color", 2, &configuration.color, CFG_COLOR_SET },
-  { "colour", 2, &configuration.color, CFG_COLOR_SET },
+  { "color", 2, NULL, OPT_COLOR },
+  { "colour", 2, NULL, OPT_COLOR },
+  { "screen", 2, NULL, OPT_SCREEN },
+  { "screen-size", 1, NULL, OPT_SCREEN_SIZE },
+  { "text", 0, NULL, OPT_TEXT },
+  { "index", 1, NULL, OPT_INDEX },
+  { "only", 1, NULL, OPT_ONLY },
+  { "stats", 2, NULL, OPT_STATS },
+  { "snapshot-every", 1, NULL, OPT_SNAPSHOT_EVERY },
+  { "snapshot-file", 1, NULL, OPT_SNAPSHOT_FILE },
+  { "listen", 1, NULL, OPT_LISTEN },
+  { "threads", 1, NULL, OPT_THREADS },
+  { "passthrough", 1, NULL, OPT_PASSTHROUGH },
+  { "command", 0, NULL, OPT_COMMAND },
+  { "record", 1, NULL, OPT_RECORD },
+  { "record-timings", 1, NULL, OPT_RECORD_TIMINGS },
+  { "timestamp", 0, NULL, OPT_TIMESTAMP },
+  { "output-compress", 1, NULL, OPT_OUTPUT_COMPRESS },
+  { "pipeline", 0, NULL, OPT_PIPELINE },
+  { "max-lookahead", 1, NULL, OPT_MAX_LOOKAHEAD },
+  { "checkpoint", 1, NULL, OPT_CHECKPOINT },
+  { "batch", 0, NULL, OPT_BATCH },
+  { "output-dir", 1, NULL, 'o' },
+  { "width", 1, NULL, OPT_WIDTH },
   { 0 }
 };
 #endif
 
+/* Parse a screen size of the form COLSxROWS. */
+int
+parse_screen_size (const char *arg, size_t *cols, size_t *rows)
+{
+  char *end;
+  unsigned long c, r;
+
+  errno = 0;
+  c = strtoul (arg, &end, 10);
+  if (end == arg || (*end != 'x' && *end != 'X'))
+    return -1;
+  arg = end + 1;
+  r = strtoul (arg, &end, 10);
+  if (end == arg || *end != '\0' || errno != 0 || c == 0 || r == 0
+      || c > USHRT_MAX || r > USHRT_MAX)
+    return -1;
+  *cols = c;
+  *rows = r;
+  return 0;
+}
+
+/* Parse an output compression of the form FORMAT[:LEVEL]. */
+int
+parse_compress (const char *arg, int *format, int *level)
+{
+  const char *colon = strchr (arg, ':');
+  size_t len = colon ? (size_t) (colon - arg) : strlen (arg);
+  char *end;
+  long l;
+
+  if (len == 4 && !strncmp (arg, "gzip", 4))
+    *format = CFG_COMPRESS_GZIP;
+  else if (len == 4 && !strncmp (arg, "zstd", 4))
+    *format = CFG_COMPRESS_ZSTD;
+  else
+    return -1;
+  *level = -1;
+  if (!colon)
+    return 0;
+  errno = 0;
+  l = strtol (colon + 1, &end, 10);
+  if (end == colon + 1 || *end != '\0' || errno != 0
+      || l < 1 || l > (*format == CFG_COMPRESS_GZIP ? 9 : 22))
+    return -1;
+  *level = l;
+  return 0;
+}
+
+/* Parse a snapshot interval: a number of bytes, or a number of
+   seconds followed by "s". */
+int
+parse_snapshot_every (const char *arg, off_t *bytes, double *secs)
+{
+  char *end;
+
+  errno = 0;
+  if (arg[0] != '\0' && arg[strlen (arg) - 1] == 's')
+    {
+      double d = strtod (arg, &end);
+      if (end == arg || *end != 's' || errno != 0 || !(d > 0.0))
+        return -1;
+      *secs = d;
+      *bytes = 0;
+    }
+  else
+    {
+      unsigned long n = strtoul (arg, &end, 10);
+      if (end == arg || *end != '\0' || errno != 0 || n == 0
+          || arg[0] == '-')
+        return -1;
+      *bytes = n;
+      *secs = 0.0;
+    }
+  return 0;
+}
+
+/* Parse the argument to --only: a comma-separated list of "text",
+   "delay", "control", "csi" and "esc", each of the last three
+   optionally followed by ":NAME" to select only that control or
+   function. Returns 0 on success, or -1 if ARG is invalid. */
+int
+parse_only (struct only_filter *only, const char *arg)
+{
+  char *list = strdup (arg);
+  size_t n = 1;
+  char *item, *name, *c;
+
+  if (!list)
+    {
+      fprintf (stderr, "%s: Out of memory.\n", program_name);
+      exit (EXIT_FAILURE);
+    }
+  for (c = list; *c; ++c)
+    {
+      if (*c == ',')
+        ++n;
+      *c = toupper ((unsigned char) *c);
+    }
+  only->csi = malloc (n * sizeof *only->csi);
+  only->esc = malloc (n * sizeof *only->esc);
+  if (!only->csi || !only->esc)
+    {
+      fprintf (stderr, "%s: Out of memory.\n", program_name);
+      exit (EXIT_FAILURE);
+    }
+  only->active = 1;
+  for (item = strtok (list, ","); item; item = strtok (NULL, ","))
+    {
+      name = strchr (item, ':');
+      if (name)
+        *name++ = '\0';
+      if (name && *name == '\0')
+        return -1;
+      if (!strcmp (item, "TEXT") && !name)
+        only->text = 1;
+      else if (!strcmp (item, "DELAY") && !name)
+        only->delays = 1;
+      else if (!strcmp (item, "CONTROL"))
+        {
+          size_t i;
+          if (!name)
+            {
+              only->all_controls = 1;
+              continue;
+            }
+          for (i = 0; i != N_ARY_ELEMS (control_names); ++i)
+            if (!strcmp (name, control_names[i]))
+              break;
+          if (i == N_ARY_ELEMS (control_names) && strcmp (name, "DEL") != 0)
+            return -1;
+          only->controls[i] = 1;
+        }
+      else if (!strcmp (item, "CSI"))
+        {
+          if (name)
+            only->csi[only->n_csi++] = name;
+          else
+            only->all_csi = 1;
+        }
+      else if (!strcmp (item, "ESC"))
+        {
+          if (name)
+            only->esc[only->n_esc++] = name;
+          else
+            only->all_esc = 1;
+        }
+      else
+        return -1;
+    }
+  return 0;
+}
+
+/* Handle a line of text as it leaves the screen. */
+void
+history_line (const char *text, size_t len, off_t offset, double time,
+              void *arg)
+{
+  struct processor *p = arg;
+
+  if (p->cfg->screen == CFG_SCREEN_TEXT
+      && (fwrite (text, 1, len, p->outf) != len
+          || putc ('\n', p->outf) == EOF))
+    p->handler (errno, p->handler_arg);
+  if (p->index && index_add_line (p->index, text, len, offset, time) != 0)
+    {
+      fprintf (stderr, "%s: Out of memory.\n", program_name);
+      exit (EXIT_FAILURE);
+    }
+}
+
+/* Set up P, configured by CFG, to read INF and write OUTF. If INF is
+   NULL, P's input is pushed to it with processor_feed. The buffers
+   are allocated from P's arena, which is made if P doesn't have one
+   yet. Returns 0 on success, or -1 if out of memory. */
+static int
+processor_init (struct processor *p, const struct config *cfg,
+                FILE *inf, FILE *outf)
+{
+  if (!p->arena && !(p->arena = arena_new (ARENA_SIZE)))
+    return -1;
+  p->cfg = cfg;
+  p->st = ST_INIT;
+  p->timings = cfg->timings;
+  p->in_header = cfg->timings != NULL;
+  p->inf = inf;
+  p->outf = outf;
+  p->ibuf = inputbuf_new_in (p->arena, inf, LOOKAHEAD_SIZE);
+  if (p->ibuf)
+    inputbuf_set_max (p->ibuf, cfg->max_lookahead);
+  p->putr = putter_new_in (p->arena, outf, cfg->color == CFG_COLOR_ALWAYS
+                                           ? &cfg->colors : NULL);
+  if (p->cfg->screen || p->cfg->snapshots || p->cfg->index)
+    p->screen = screen_new (outf, p->cfg->screen_cols,
+                            p->cfg->screen_rows);
+  if (p->cfg->index)
+    p->index = index_new ();
+  if (p->cfg->stats)
+    p->stats = stats_new ();
+  if (!p->ibuf || !p->putr
+      || ((p->cfg->screen || p->cfg->snapshots
+           || p->cfg->index) && !p->screen)
+      || (p->cfg->index && !p->index)
+      || (p->cfg->stats && !p->stats))
+    return -1;
+  if (cfg->width != CFG_WIDTH_AUTO)
+    putter_set_width (p->putr, cfg->width);
+  processor_set_handler (p, handle_write_error, (void *)program_name);
+  if (p->screen
+      && (p->cfg->screen == CFG_SCREEN_TEXT || p->index))
+    screen_set_history (p->screen, history_line, p);
+  return 0;
+}
+
+/* Carry on, with P, from where the last run with CFG's checkpoint got
+   to, reading the input on FD from there; or, if it was another file,
+   finish off what it left, and read this one from where it is. */
+static void
+resume_checkpoint (struct processor *p, const struct config *cfg, int fd)
+{
+  struct checkpoint ck;
+  struct stat s;
+  int r = checkpoint_read (cfg->checkpoint, &ck);
+
+  if (r == -1 || fstat (fd, &s) != 0)
+    exit (EXIT_FAILURE);
+  p->resumed_at = lseek (fd, 0, SEEK_CUR);
+  if (r == 0)
+    return;
+  p->st = ck.state;
+  p->print_dot = ck.print_dot;
+  if (ck.column != 0 && p->st == ST_TEXT)
+    putter_resume (p->putr, &cfg->colors.text, &cfg->colors.text_decor,
+                   "|-", "-|", ck.column);
+  else if (ck.column != 0 && p->st == ST_CTRL)
+    putter_resume (p->putr, &cfg->colors.ctrl, NULL, "", ".", ck.column);
+  if (ck.dev != s.st_dev || ck.ino != s.st_ino || ck.offset > s.st_size)
+    {
+      finish_state (p);
+      p->print_dot = 0;
+      return;
+    }
+  if (lseek (fd, ck.offset, SEEK_SET) == -1)
+    {
+      fprintf (stderr, "%s: %s: %s\n", program_name, "read error",
+               strerror (errno));
+      exit (EXIT_FAILURE);
+    }
+  p->resumed_at = ck.offset;
+}
+
+/* Write the checkpoint for P, at the end of its input, instead of
+   finishing off the output. Returns 0 on success, or -1 (having said
+   why) on an error. */
+static int
+processor_checkpoint (struct processor *p)
+{
+  struct checkpoint ck;
+  struct stat s;
+
+  if (fstat (fileno (p->inf), &s) != 0)
+    {
+      fprintf (stderr, "%s: %s: %s\n", program_name, "read error",
+               strerror (errno));
+      return -1;
+    }
+  ck.dev = s.st_dev;
+  ck.ino = s.st_ino;
+  ck.offset = p->resumed_at + inputbuf_get_offset (p->ibuf);
+  ck.state = p->st;
+  ck.print_dot = p->print_dot;
+  ck.column = putter_column (p->putr);
+  return checkpoint_write (p->cfg->checkpoint, &ck);
+}
+
+/* Fill in CFG from the command line, and set up P to match. */
 void
-configure (struct processor *p, int argc, char **argv)
+configure (struct config *cfg, struct processor *p, int argc, char **argv)
 {
   int opt, which;
   const char *timings_fname = NULL;
+  const char *snapshots_fname = NULL;
+  const char *index_fname = NULL;
+  const char *record_fname = NULL;
+  const char *record_timings_fname = NULL;
+  int command = 0;
+  int follow = 0;
+  int batch = 0;
+  int direct;
   FILE *inf = stdin;
   FILE *outf = stdout;
-  int infd;
-
-  configuration.control_hats = 1;
-  configuration.descriptions = 1;
-  configuration.labels = 1;
-  configuration.escapes = 1;
-  configuration.buffered = 0;
-  configuration.handle_signals = 1;
-  configuration.timings = NULL;
-  configuration.color = CFG_COLOR_NONE;
+  int infd, outfd;
+
+  cfg->control_hats = 1;
+  cfg->descriptions = 1;
+  cfg->labels = 1;
+  cfg->escapes = 1;
+  cfg->buffered = 0;
+  cfg->handle_signals = 1;
+  cfg->timings = NULL;
+  cfg->color = CFG_COLOR_NONE;
+  cfg->screen = CFG_SCREEN_NONE;
+  cfg->screen_cols = SCREEN_DEFAULT_COLS;
+  cfg->screen_rows = SCREEN_DEFAULT_ROWS;
+  cfg->snapshots = NULL;
+  cfg->index = NULL;
+  cfg->stats = CFG_STATS_NONE;
+  cfg->snapshot_bytes = 0;
+  cfg->snapshot_secs = 0.0;
+  cfg->listen = NULL;
+  cfg->threads = 0;
+  cfg->passthrough = NULL;
+  cfg->command = NULL;
+  cfg->record = NULL;
+  cfg->record_timings = NULL;
+  cfg->timestamp = 0;
+  cfg->decompress = CFG_COMPRESS_NONE;
+  cfg->output_compress = CFG_COMPRESS_NONE;
+  cfg->output_compress_level = -1;
+  cfg->pipeline = 0;
+  cfg->max_lookahead = LOOKAHEAD_SIZE;
+  cfg->checkpoint = NULL;
+  cfg->follow = NULL;
+  cfg->batch_dir = NULL;
+  cfg->batch_files = NULL;
+  cfg->width = CFG_WIDTH_AUTO;
 
   program_name = argv[0];
 
   while ((opt = (
-#define ACCEPTOPTS      ":hVo:C^&D\"LEt:xbI"
+#define ACCEPTOPTS      ":hVo:C^&D\"LEt:xbfI"
 #ifdef HAVE_GETOPT_H
                  getopt_long (argc, argv, ACCEPTOPTS,
                               teseq_opts, &which)
@@ -1721,24 +2210,30 @@ configure (struct processor *p, int argc, char **argv)
           break;
         case '^':
         case 'C':
-          configuration.control_hats = 0;
+          cfg->control_hats = 0;
           break;
         case '"':
         case 'D':
-          configuration.descriptions = 0;
+          cfg->descriptions = 0;
           break;
         case '&':
         case 'L':
-          configuration.labels = 0;
+          cfg->labels = 0;
           break;
         case 'E':
-          configuration.escapes = 0;
+          cfg->escapes = 0;
           break;
         case 'I':
-          configuration.handle_signals = 0;
+          cfg->handle_signals = 0;
           break;
         case 'b':
-          configuration.buffered = 1;
+          cfg->buffered = 1;
+          break;
+        case 'f':
+          follow = 1;
+          break;
+        case 'o':
+          cfg->batch_dir = optarg;
           break;
         case 't':
           timings_fname = optarg;
@@ -1747,33 +2242,185 @@ configure (struct processor *p, int argc, char **argv)
           /* Used to control whether we print descriptions of
            * non-ANSI-defined sequences. This option is always on now. */
           break;
-        case ':':
-          fprintf (stderr, "Option -%c requires an argument.\n\n", optopt);
-          usage (EXIT_FAILURE);
+        case OPT_SCREEN:
+          cfg->screen = CFG_SCREEN_DUMP;
+          if (optarg
+              && parse_screen_size (optarg, &cfg->screen_cols,
+                                    &cfg->screen_rows) != 0)
+            {
+              fprintf (stderr,
+                       "Option --screen: Invalid size ``%s''.\n\n",
+                       optarg);
+              usage (EXIT_FAILURE);
+            }
+          break;
+        case OPT_TEXT:
+          cfg->screen = CFG_SCREEN_TEXT;
           break;
-        case 0:
-          /* Long-only option. */
-          if (configuration.color == CFG_COLOR_SET)
+        case OPT_STATS:
+          if (!optarg || !strcasecmp (optarg, "table"))
+            cfg->stats = CFG_STATS_TABLE;
+          else if (!strcasecmp (optarg, "json"))
+            cfg->stats = CFG_STATS_JSON;
+          else
             {
-              if (!optarg || !strcasecmp(optarg, "always"))
-                configuration.color = CFG_COLOR_ALWAYS;
-              else if (!strcasecmp(optarg, "none"))
-                configuration.color = CFG_COLOR_NONE;
-              else if (!strcasecmp(optarg, "auto"))
-                configuration.color = CFG_COLOR_AUTO;
-              else
+              fprintf (stderr,
+                       "Option --stats: Unknown format ``%s''.\n\n",
+                       optarg);
+              usage (EXIT_FAILURE);
+            }
+          break;
+        case OPT_ONLY:
+          if (parse_only (&cfg->only, optarg) != 0)
+            {
+              fprintf (stderr,
+                       "Option --only: Invalid event list ``%s''.\n\n",
+                       optarg);
+              usage (EXIT_FAILURE);
+            }
+          break;
+        case OPT_INDEX:
+          index_fname = optarg;
+          break;
+        case OPT_SCREEN_SIZE:
+          if (parse_screen_size (optarg, &cfg->screen_cols,
+                                 &cfg->screen_rows) != 0)
+            {
+              fprintf (stderr,
+                       "Option --screen-size: Invalid size ``%s''.\n\n",
+                       optarg);
+              usage (EXIT_FAILURE);
+            }
+          break;
+        case OPT_SNAPSHOT_EVERY:
+          if (parse_snapshot_every (optarg, &cfg->snapshot_bytes,
+                                    &cfg->snapshot_secs) != 0)
+            {
+              fprintf (stderr,
+                       "Option --snapshot-every: Invalid interval ``%s''.\n\n",
+                       optarg);
+              usage (EXIT_FAILURE);
+            }
+          break;
+        case OPT_SNAPSHOT_FILE:
+          snapshots_fname = optarg;
+          break;
+        case OPT_LISTEN:
+          cfg->listen = optarg;
+          break;
+        case OPT_THREADS:
+          {
+            char *end;
+            cfg->threads = strtol (optarg, &end, 10);
+            if (end == optarg || *end != '\0' || cfg->threads <= 0)
+              {
+                fprintf (stderr,
+                         "Option --threads: Invalid count ``%s''.\n\n",
+                         optarg);
+                usage (EXIT_FAILURE);
+              }
+          }
+          break;
+        case OPT_PASSTHROUGH:
+          cfg->passthrough = optarg;
+          break;
+        case OPT_COMMAND:
+          command = 1;
+          break;
+        case OPT_RECORD:
+          record_fname = optarg;
+          break;
+        case OPT_RECORD_TIMINGS:
+          record_timings_fname = optarg;
+          break;
+        case OPT_TIMESTAMP:
+          cfg->timestamp = 1;
+          break;
+        case OPT_OUTPUT_COMPRESS:
+          if (parse_compress (optarg, &cfg->output_compress,
+                              &cfg->output_compress_level) != 0)
+            {
+              fprintf (stderr,
+                       "Option --output-compress: Invalid compression"
+                       " ``%s''.\n\n", optarg);
+              usage (EXIT_FAILURE);
+            }
+          break;
+        case OPT_PIPELINE:
+          cfg->pipeline = 1;
+          break;
+        case OPT_MAX_LOOKAHEAD:
+          {
+            char *end;
+            unsigned long n;
+
+            errno = 0;
+            n = strtoul (optarg, &end, 10);
+            if (end == optarg || *end != '\0' || errno != 0
+                || n < LOOKAHEAD_SIZE || n > SIZE_MAX / 2)
+              {
+                fprintf (stderr,
+                         "Option --max-lookahead: Invalid size ``%s''"
+                         " (it must be at least %d).\n\n", optarg,
+                         LOOKAHEAD_SIZE);
+                usage (EXIT_FAILURE);
+              }
+            cfg->max_lookahead = n;
+          }
+          break;
+        case OPT_CHECKPOINT:
+          cfg->checkpoint = optarg;
+          break;
+        case OPT_BATCH:
+          batch = 1;
+          break;
+        case OPT_WIDTH:
+          if (!strcasecmp (optarg, "unlimited"))
+            cfg->width = CFG_WIDTH_UNLIMITED;
+          else if (!strcasecmp (optarg, "auto"))
+            cfg->width = CFG_WIDTH_AUTO;
+          else
+            {
+              char *end;
+              unsigned long n;
+
+              errno = 0;
+              n = strtoul (optarg, &end, 10);
+              if (end == optarg || *end != '\0' || errno != 0
+                  || n < WIDTH_MIN || n >= CFG_WIDTH_AUTO)
                 {
                   fprintf (stderr,
-                           "Option --color: Unknown argument ``%s''.\n\n",
-                           optarg);
+                           "Option --width: Invalid width ``%s''"
+                           " (it must be at least %d).\n\n", optarg,
+                           WIDTH_MIN);
                   usage (EXIT_FAILURE);
                 }
+              cfg->width = n;
+            }
+          break;
+        case ':':
+          fprintf (stderr, "Option -%c requires an argument.\n\n", optopt);
+          usage (EXIT_FAILURE);
+          break;
+        case OPT_COLOR:
+          if (!optarg || !strcasecmp(optarg, "always"))
+            cfg->color = CFG_COLOR_ALWAYS;
+          else if (!strcasecmp(optarg, "none"))
+            cfg->color = CFG_COLOR_NONE;
+          else if (!strcasecmp(optarg, "auto"))
+            cfg->color = CFG_COLOR_AUTO;
+          else
+            {
+              fprintf (stderr,
+                       "Option --color: Unknown argument ``%s''.\n\n",
+                       optarg);
+              usage (EXIT_FAILURE);
             }
           break;
         default:
           if (optopt == ':')
             {
-              configuration.escapes = 0;
+              cfg->escapes = 0;
               break;
             }
           fprintf (stderr, "Unrecognized option -%c.\n\n", optopt);
@@ -1781,6 +2428,97 @@ configure (struct processor *p, int argc, char **argv)
           break;
         }
     }
+  if (cfg->listen
+      && (argv[optind] != NULL || timings_fname != NULL
+          || snapshots_fname != NULL || index_fname != NULL
+          || cfg->output_compress || cfg->pipeline))
+    {
+      fprintf (stderr, "Option --listen can't be used with files, or with"
+               " --timings, --index, --snapshot-file, --output-compress"
+               " or --pipeline.\n\n");
+      usage (EXIT_FAILURE);
+    }
+  if (command
+      && (argv[optind] == NULL || cfg->listen || timings_fname != NULL))
+    {
+      fprintf (stderr, "Option --command needs a command to run, and can't"
+               " be used with --listen or --timings.\n\n");
+      usage (EXIT_FAILURE);
+    }
+  if (cfg->timestamp && (cfg->listen || timings_fname != NULL))
+    {
+      fprintf (stderr, "Option --timestamp can't be used with --listen"
+               " or --timings.\n\n");
+      usage (EXIT_FAILURE);
+    }
+  if (!command && !cfg->timestamp
+      && (record_fname != NULL || record_timings_fname != NULL))
+    {
+      fprintf (stderr, "Options --record and --record-timings"
+               " require --command or --timestamp.\n\n");
+      usage (EXIT_FAILURE);
+    }
+  if (cfg->checkpoint
+      && (cfg->listen || command || timings_fname != NULL
+          || cfg->timestamp || cfg->screen || cfg->stats
+          || index_fname != NULL || snapshots_fname != NULL
+          || cfg->color == CFG_COLOR_ALWAYS))
+    {
+      fprintf (stderr, "Option --checkpoint can't be used with --listen,"
+               " --command, --timings, --timestamp, --screen, --text,"
+               " --stats, --index, --snapshot-file or"
+               " --color=always.\n\n");
+      usage (EXIT_FAILURE);
+    }
+  if (follow
+      && (argv[optind] == NULL || strcmp (argv[optind], "-") == 0
+          || cfg->listen || command || timings_fname != NULL
+          || cfg->timestamp || cfg->passthrough || cfg->pipeline
+          || cfg->checkpoint))
+    {
+      fprintf (stderr, "Option --follow needs an INPUT file, and can't be"
+               " used with --listen, --command, --timings, --timestamp,"
+               " --passthrough, --pipeline or --checkpoint.\n\n");
+      usage (EXIT_FAILURE);
+    }
+  if (batch != (cfg->batch_dir != NULL)
+      || (batch
+          && (cfg->listen || command || follow || timings_fname != NULL
+              || cfg->timestamp || cfg->passthrough || cfg->pipeline
+              || cfg->checkpoint || cfg->output_compress
+              || index_fname != NULL || snapshots_fname != NULL)))
+    {
+      fprintf (stderr, "Options --batch and -o must be given together,"
+               " and can't be used with --listen, --command, --follow,"
+               " --timings, --timestamp, --passthrough, --pipeline,"
+               " --checkpoint, --output-compress, --index or"
+               " --snapshot-file.\n\n");
+      usage (EXIT_FAILURE);
+    }
+  if (batch && argv[optind] != NULL)
+    {
+      /* The rest of the arguments are the files to decode. */
+      cfg->batch_files = argv + optind;
+      optind = argc;
+    }
+  if (command)
+    {
+      /* The rest of the arguments are the command, not files. */
+      cfg->command = argv + optind;
+      optind = argc;
+    }
+  if (cfg->passthrough
+      && (cfg->listen || (argv[optind] && argv[optind + 1])))
+    {
+      fprintf (stderr, "Option --passthrough can't be used with an OUTPUT"
+               " file, or with --listen.\n\n");
+      usage (EXIT_FAILURE);
+    }
+  if (follow)
+    {
+      /* It's opened again by this name if it's replaced. */
+      cfg->follow = argv[optind];
+    }
   if (argv[optind] != NULL)
     {
       inf = must_fopen (argv[optind++], "r", 1);
@@ -1789,14 +2527,132 @@ configure (struct processor *p, int argc, char **argv)
     {
       outf = must_fopen (argv[optind++], "w", 1);
     }
+  if (cfg->passthrough)
+    {
+      /* The standard output gets the input itself; see passthrough.c. */
+      outf = must_fopen (cfg->passthrough, "w", 0);
+    }
   if (timings_fname != NULL)
     {
-      configuration.timings = must_fopen (timings_fname, "r", 0);
+      cfg->timings = must_fopen (timings_fname, "r", 0);
     }
+  if (record_fname != NULL)
+    {
+      cfg->record = must_fopen (record_fname, "w", 0);
+    }
+  if (record_timings_fname != NULL)
+    {
+      cfg->record_timings = must_fopen (record_timings_fname, "w", 0);
+    }
+  if ((snapshots_fname != NULL)
+      != (cfg->snapshot_bytes != 0
+          || cfg->snapshot_secs != 0.0))
+    {
+      fprintf (stderr, "Options --snapshot-every and --snapshot-file"
+               " must be given together.\n\n");
+      usage (EXIT_FAILURE);
+    }
+  if (cfg->snapshot_secs != 0.0 && !cfg->timings && !cfg->timestamp)
+    {
+      fprintf (stderr, "Option --snapshot-every: Intervals in seconds"
+               " require --timings or --timestamp.\n\n");
+      usage (EXIT_FAILURE);
+    }
+  if (snapshots_fname != NULL)
+    {
+      cfg->snapshots = must_fopen (snapshots_fname, "w", 0);
+      if (fprintf (cfg->snapshots, "teseq snapshots %lux%lu\n",
+                   (unsigned long) cfg->screen_cols,
+                   (unsigned long) cfg->screen_rows) < 0)
+        handle_write_error (errno, (void *)program_name);
+      p->snap_next_offset = cfg->snapshot_bytes;
+    }
+  if (index_fname != NULL)
+    {
+      cfg->index = must_fopen (index_fname, "wb", 0);
+    }
+  if (cfg->stats)
+    {
+      /* The statistics replace any other output. */
+      cfg->screen = CFG_SCREEN_NONE;
+    }
+  if (cfg->screen || cfg->stats)
+    {
+      /* The screen replaces the usual output. */
+      cfg->escapes = 0;
+      cfg->labels = 0;
+      cfg->descriptions = 0;
+    }
+
+  if (cfg->listen || cfg->batch_dir)
+    {
+      /* Each stream or file gets its own processor; see server.c
+         and batch.c. */
+      if (cfg->color == CFG_COLOR_AUTO)
+        cfg->color = CFG_COLOR_NONE;
+      color_setup (cfg);
+      return;
+    }
+
+  if (!cfg->passthrough && !cfg->command && !cfg->timestamp)
+    cfg->decompress = decompress_detect (fileno (inf));
+  if (cfg->checkpoint)
+    {
+      struct stat s;
+
+      /* The checkpoint is a place in the file; see checkpoint.h. */
+      if (fstat (fileno (inf), &s) != 0 || !S_ISREG (s.st_mode)
+          || cfg->decompress)
+        {
+          fprintf (stderr, "%s: --checkpoint needs its input to be a"
+                   " regular file, and not compressed.\n", program_name);
+          exit (EXIT_FAILURE);
+        }
+      if (cfg->color == CFG_COLOR_AUTO)
+        cfg->color = CFG_COLOR_NONE;
+    }
+  if (cfg->follow)
+    {
+      struct stat s;
+
+      /* It's the file that's followed, not what's been written to
+         it; see follow.h. */
+      if (fstat (fileno (inf), &s) != 0 || !S_ISREG (s.st_mode)
+          || cfg->decompress)
+        {
+          fprintf (stderr, "%s: --follow needs its input to be a"
+                   " regular file, and not compressed.\n", program_name);
+          exit (EXIT_FAILURE);
+        }
+    }
+
+  /* In these modes, the input is read from its descriptor, and fed to
+     P as it arrives, rather than through P's input buffer. So is the
+     screen's, a block at a time, unless it's being typed. */
+  direct = (cfg->passthrough || cfg->command || cfg->timestamp
+            || cfg->decompress || cfg->pipeline || cfg->checkpoint
+            || cfg->follow || (cfg->screen && !isatty (fileno (inf))));
+  cfg->direct = direct;
 
   /* Set input/output to unbuffered. */
   infd = fileno (inf);
-  if (!configuration.buffered)
+  outfd = fileno (outf);
+  if (cfg->output_compress || cfg->pipeline)
+    {
+      /* Output written by a thread of its own is handed to it in
+         blocks; see compress.c. */
+      outf = compress_open (outf, cfg->output_compress,
+                            cfg->output_compress_level);
+      if (!outf)
+        exit (EXIT_FAILURE);
+    }
+#ifdef ENABLE_INSTRUMENTATION
+  if (!direct)
+    inf = instr_wrap (inf, "r");
+  outf = instr_wrap (outf, "w");
+  instr_setup ();
+#endif
+  if (!cfg->buffered)
     {
       /* Don't unbuffer if input's a plain file. */
       struct stat s;
@@ -1805,42 +2661,146 @@ configure (struct processor *p, int argc, char **argv)
       if (r == -1 || !S_ISREG (s.st_mode))
         {
           setvbuf (inf, NULL, _IONBF, 0);
-          setvbuf (outf, NULL, _IONBF, 0);
+          if (!cfg->output_compress && !cfg->pipeline)
+            setvbuf (outf, NULL, _IONBF, 0);
         }
     }
 
-  output_tty_p = isatty (fileno (outf));
+  cfg->output_tty = isatty (outfd);
+  if (cfg->width == CFG_WIDTH_AUTO && cfg->output_tty)
+    {
+      /* Leave the last two columns free, as 78 does on 80. */
+      size_t cols = tty_width (outfd);
+      if (cols >= WIDTH_MIN + 2)
+        cfg->width = cols - 2;
+    }
 
-  if (configuration.color != CFG_COLOR_AUTO)
+  if (cfg->color != CFG_COLOR_AUTO)
     ; /* Nothing to do. */
-  else if (output_tty_p)
-    configuration.color = CFG_COLOR_ALWAYS;
+  else if (cfg->output_tty)
+    cfg->color = CFG_COLOR_ALWAYS;
   else
-    configuration.color = CFG_COLOR_NONE;
+    cfg->color = CFG_COLOR_NONE;
 
-  color_setup ();
+  color_setup (cfg);
 
-  if (configuration.handle_signals)
+  /* Input read directly is read without checking for a caught
+     signal, and a command run by --command gets the signals itself;
+     leave them alone. */
+  if (cfg->handle_signals && !direct)
     {
       if (isatty (infd))
-        tty_setup (infd);
+        tty_setup (infd, cfg->output_tty);
       signal_setup ();
     }
   
-  p->ibuf = inputbuf_new (inf, 1024);
-  p->putr = putter_new (outf);
-  if (!p->ibuf || !p->putr)
+  if (processor_init (p, cfg, direct ? NULL : inf, outf) != 0)
     {
       fprintf (stderr, "%s: Out of memory.\n", program_name);
       exit (EXIT_FAILURE);
     }
-  putter_set_handler (p->putr, handle_write_error, (void *)program_name);
+  p->inf = inf;
+  if (cfg->checkpoint)
+    resume_checkpoint (p, cfg, infd);
+}
+
+/* Write out the screen, preceded by any delay that's been
+   accumulated since the last time we did so. */
+void
+dump_screen (struct processor *p)
+{
+  if (p->screen_delay_pending)
+    {
+      putter_single_delay (p->putr, "%f", p->screen_delay);
+      p->screen_delay = 0.0;
+      p->screen_delay_pending = 0;
+    }
+  if (screen_dump (p->screen) != 0)
+    p->handler (errno, p->handler_arg);
+}
+
+/* In screen mode, each delay is a point at which we show the screen
+   (if it changed). Delays between unchanged screens are combined. */
+void
+screen_delay (struct processor *p, double delay)
+{
+  if (screen_is_dirty (p->screen))
+    dump_screen (p);
+  p->screen_delay += delay;
+  p->screen_delay_pending = 1;
+}
+
+/* Every so many snapshots, write the whole screen, so that a reader
+   needn't go all the way back to the first snapshot to reconstruct
+   one. */
+#define SNAPSHOT_KEYFRAME_INTERVAL      64
+
+/* Write a snapshot of the screen to the snapshots file: a header line
+   "F" (for a full snapshot) or "S" (for only the rows that changed
+   since the previous one), followed by the snapshot number, the input
+   offset and the elapsed time; then the rows themselves. A delta in
+   which nothing changed is skipped. */
+void
+take_snapshot (struct processor *p)
+{
+  FILE *f = p->cfg->snapshots;
+  int full = (p->snap_count % SNAPSHOT_KEYFRAME_INTERVAL == 0);
+
+  if (!full && !screen_changed_since (p->screen, p->snap_seen))
+    return;
+  if (fprintf (f, "%c %lu %jd %f\n", full ? 'F' : 'S', p->snap_count,
+               (intmax_t) inputbuf_get_offset (p->ibuf), p->elapsed) < 0
+      || screen_snapshot (p->screen, f, &p->snap_seen, full) != 0)
+    handle_write_error (errno, (void *)program_name);
+  ++p->snap_count;
+}
+
+/* Take a snapshot if we've passed the next byte interval. */
+void
+snapshot_bytes (struct processor *p)
+{
+  off_t offset = inputbuf_get_offset (p->ibuf);
+
+  take_snapshot (p);
+  while (p->snap_next_offset <= offset)
+    p->snap_next_offset += p->cfg->snapshot_bytes;
+}
+
+/* A delay is about to happen; take a snapshot first, if one is
+   due. */
+void
+snapshot_delay (struct processor *p)
+{
+  if (p->cfg->snapshot_secs != 0.0 && p->snap_next_time <= p->elapsed)
+    {
+      take_snapshot (p);
+      p->snap_next_time = p->elapsed + p->cfg->snapshot_secs;
+    }
+}
+
+/* A delay of SECS has passed. The first delay, before any input,
+   isn't shown. */
+static void
+show_delay (struct processor *p, double secs)
+{
+  if (!p->delay_started)
+    {
+      p->delay_started = 1;
+      return;
+    }
+  if (p->cfg->snapshots)
+    snapshot_delay (p);
+  p->elapsed += secs;
+  if (p->cfg->screen == CFG_SCREEN_DUMP)
+    screen_delay (p, secs);
+  else if (!p->cfg->screen && !p->cfg->stats
+           && SHOW_DELAY)
+    putter_single_delay (p->putr, "%f", secs);
 }
 
 void
 emit_delay (struct processor *p)
 {
-  static int first = 1;
   size_t count = inputbuf_get_count (p->ibuf);
   finish_state (p);
   do
@@ -1853,15 +2813,13 @@ emit_delay (struct processor *p)
          remember the number-of-bytes field), and execute the second,
          before _we_ process the byte. */
       struct delay d;
-      delay_read (configuration.timings, &d);
+      if (delay_read (p->timings, &d) != 0)
+        p->timings = NULL;
       p->mark += p->next_mark;
       p->next_mark = d.chars;
-      if (first)
-        first = 0;
-      else
-        putter_single_delay (p->putr, "%f", d.time);
+      show_delay (p, d.time);
     }
-  while (configuration.timings && p->mark <= count);
+  while (p->timings && p->mark <= count);
 
   /* Following couple lines aren't strictly necessary,
      but keep the count/mark from getting huge, and avoid the
@@ -1870,49 +2828,494 @@ emit_delay (struct processor *p)
   inputbuf_reset_count (p->ibuf);
 }
 
-#define SHOULD_EMIT_DELAY(p)    (configuration.timings && \
+#define SHOULD_EMIT_DELAY(p)    ((p)->timings && \
                                  (p)->mark <= inputbuf_get_count ((p)->ibuf))
+#define SHOULD_SNAPSHOT(p)      ((p)->cfg->snapshot_bytes && \
+                                 (p)->snap_next_offset \
+                                   <= inputbuf_get_offset ((p)->ibuf))
+
+/* Do whatever is due before the next character is read: delays,
+   snapshots, and keeping the index's clock. */
+static void
+before_char (struct processor *p)
+{
+  if (p->in_header)
+    return;
+  if (SHOULD_EMIT_DELAY (p))
+    emit_delay (p);
+  if (SHOULD_SNAPSHOT (p))
+    snapshot_bytes (p);
+  if (p->index)
+    screen_set_clock (p->screen, inputbuf_get_offset (p->ibuf), p->elapsed);
+}
 
-int
-main (int argc, char **argv)
+/* In timings mode, the delays only start after the timestamp line
+   from script (or at the end of the input, if that's all there is). */
+static void
+end_header (struct processor *p)
 {
-  int c;
-  int err;
-  struct processor p = { 0, 0, ST_INIT };
+  p->in_header = 0;
+  inputbuf_reset_count (p->ibuf);
+}
+
+/* Process C, the next character of the input. */
+static void
+process_input (struct processor *p, unsigned char c)
+{
+  process (p, c);
+  if (p->in_header && c == '\n')
+    end_header (p);
+}
+
+/* Free what processor_init allocated for P outside of its arena. */
+static void
+processor_release_extras (struct processor *p)
+{
+  if (p->ibuf)
+    inputbuf_delete (p->ibuf);
+  if (p->screen)
+    screen_delete (p->screen);
+  if (p->index)
+    index_delete (p->index);
+  if (p->stats)
+    stats_delete (p->stats);
+}
+
+/* Free everything processor_init allocated for P (and P itself, if
+   it's in its arena). */
+static void
+processor_release (struct processor *p)
+{
+  struct arena *a = p->arena;
+
+  processor_release_extras (p);
+  if (a)
+    arena_delete (a);
+}
+
+/* Make a processor at the start of arena A. */
+static struct processor *
+processor_make (struct arena *a, const struct config *cfg, FILE *outf)
+{
+  struct processor *p = arena_alloc (a, sizeof *p);
+
+  if (!p)
+    return NULL;
+  memset (p, 0, sizeof *p);
+  p->arena = a;
+  if (processor_init (p, cfg, NULL, outf) != 0)
+    {
+      processor_release_extras (p);
+      return NULL;
+    }
+  return p;
+}
 
-  configure (&p, argc, argv);
-  /* If we're in timings mode, we need to handle up to the first
-     newline without checking the delay, because that's the timestamp
-     line from script, and the delays don't start until after that. */
-  if (configuration.timings) 
+/* Make a processor, configured by CFG, that writes to OUTF, and whose
+   input is handed to it with processor_feed. CFG must outlive it.
+   Returns NULL if out of memory. */
+struct processor *
+processor_new (const struct config *cfg, FILE *outf)
+{
+  struct arena *a = arena_new (ARENA_SIZE);
+  struct processor *p;
+
+  if (!a)
+    return NULL;
+  p = processor_make (a, cfg, outf);
+  if (!p)
+    arena_delete (a);
+  return p;
+}
+
+void
+processor_delete (struct processor *p)
+{
+  processor_release (p);
+}
+
+/* Start P over, on a new stream written to OUTF, reusing its memory.
+   Returns the new processor, which replaces P; or NULL (with P
+   deleted) if out of memory. */
+struct processor *
+processor_reuse (struct processor *p, FILE *outf)
+{
+  struct arena *a = p->arena;
+  const struct config *cfg = p->cfg;
+
+  processor_release_extras (p);
+  arena_reset (a);
+  p = processor_make (a, cfg, outf);
+  if (!p)
+    arena_delete (a);
+  return p;
+}
+
+/* Write errors are passed to F, along with ARG, rather than ending
+   the program. */
+void
+processor_set_handler (struct processor *p, putter_error_handler f,
+                       void *arg)
+{
+  p->handler = f;
+  p->handler_arg = arg;
+  putter_set_handler (p->putr, f, arg);
+  if (p->screen)
+    screen_set_handler (p->screen, f, arg);
+}
+
+/* Whether the input pushed so far holds all of the escape sequence
+   whose Esc has just been read: that is, something that ends it
+   (validly or not), or more than we'd look ahead through anyway. */
+static int
+escape_complete (struct processor *p)
+{
+  int c = inputbuf_peek (p->ibuf, 0);
+  const unsigned char *span;
+  size_t len;
+  int hi;
+  size_t i;
+
+  if (c == '[')
+    hi = 0x3f;
+  else if (c != EOF && IS_nF_INTERMEDIATE_CHAR (c))
+    hi = 0x2f;
+  else
+    return c != EOF;
+  for (i = 1; i + 1 < p->cfg->max_lookahead; i += len)
     {
-      while ((c = inputbuf_get (p.ibuf)) != EOF)
+      const unsigned char *s, *e;
+
+      len = inputbuf_span (p->ibuf, i, &span);
+      if (len == 0)
+        return 0;
+      if (len > p->cfg->max_lookahead - 1 - i)
+        len = p->cfg->max_lookahead - 1 - i;
+      for (s = span, e = span + len; s != e; ++s)
+        if (*s < 0x20 || *s > hi)
+          return 1;
+    }
+  return 1;
+}
+
+/* Note that SECS passed before the next bytes to be fed arrived, as
+   for --timestamp. Unlike the first delay from a timings file, the
+   wait for the first bytes is real, and is shown. */
+void
+processor_delay (struct processor *p, double secs)
+{
+  finish_state (p);
+  p->delay_started = 1;
+  show_delay (p, secs);
+}
+
+/* In screen mode, nothing but the screen is kept up to date, so
+   plain text and control sequences can go to it straight from the
+   input pushed to P, rather than a character at a time (see
+   text_run and csi_run). */
+#define SCREEN_RUNS(p)  ((p)->cfg->screen && !(p)->in_header \
+                         && !(p)->index)
+
+/* The length of the run of printable ASCII that begins the input
+   pushed to P, pointed at by *SPAN, up to where anything is next due
+   before a character (see before_char). */
+static size_t
+text_run (struct processor *p, const unsigned char **span)
+{
+  const unsigned char *s, *e;
+  size_t len;
+
+  len = inputbuf_span (p->ibuf, 0, span);
+  if (p->timings && len > p->mark - inputbuf_get_count (p->ibuf))
+    len = p->mark - inputbuf_get_count (p->ibuf);
+  if (p->cfg->snapshot_bytes
+      && (off_t) len > p->snap_next_offset - inputbuf_get_offset (p->ibuf))
+    len = p->snap_next_offset - inputbuf_get_offset (p->ibuf);
+  for (s = *span, e = s + len; s != e && *s >= 0x20 && *s < 0x7f; ++s)
+    ;
+  return s - *span;
+}
+
+/* If the input pushed to P begins with a control sequence that has
+   nothing but digits and semicolons after any private marker, and is
+   all in one span, pass it to the screen as process_csi_sequence
+   would. Returns its length, or zero if it's left to be read the
+   usual way. */
+static size_t
+csi_run (struct processor *p)
+{
+  const unsigned char *span, *s, *e;
+  const struct csi_handler *handler;
+  int private_params = 0;
+  int digits = 0;
+  size_t n_params = 0;
+  size_t cur_param = 0;
+  unsigned int params[255];
+  size_t len;
+
+  len = inputbuf_span (p->ibuf, 0, &span);
+  if (len > p->cfg->max_lookahead - 1)
+    len = p->cfg->max_lookahead - 1;
+  if (len < 3 || span[0] != C_ESC || span[1] != '[')
+    return 0;
+  s = span + 2;
+  if (IS_PRIVATE_PARAM_CHAR (*s))
+    private_params = *s++;
+  for (e = span + len; s != e && (is_ascii_digit (*s) || *s == ';'); ++s)
+    ;
+  if (s == e || !IS_CSI_FINAL_CHAR (*s))
+    return 0;
+  handler = get_csi_handler (private_params, 0, 0, *s);
+  if (!handler)
+    return 0;
+
+  /* A parameter that's left out takes its default. */
+  for (e = s, s = span + 2 + (private_params != 0); ; ++s)
+    {
+      if (s != e && is_ascii_digit (*s))
         {
-          process (&p, c);
-          if (c == '\n') break;
+          if (!digits)
+            cur_param = 0;
+          cur_param = cur_param * 10 + (*s - '0');
+          digits = 1;
+          continue;
+        }
+      if (digits)
+        {
+          if (n_params < N_ARY_ELEMS (params))
+            params[n_params++] = cur_param;
+        }
+      else if (n_params < N_ARY_ELEMS (params))
+        {
+          int param = CSI_GET_DEFAULT (handler, n_params);
+          if (param >= 0)
+            params[n_params++] = param;
         }
-      inputbuf_reset_count (p.ibuf);
+      digits = 0;
+      if (s == e)
+        break;
     }
+
+  p->shown = SHOW_CSI (handler->acro);
+  if (p->shown)
+    p->print_dot = 1;
+  screen_csi (p->screen, *e, private_params, 0, n_params, params);
+  return e - span + 1;
+}
+
+/* Process the LEN bytes at BUF. An escape sequence that isn't all
+   there yet is kept, to be finished by the next call. A LEN of zero
+   marks the end of the input. */
+void
+processor_feed (struct processor *p, const unsigned char *buf, size_t len)
+{
+  int c;
+
+  inputbuf_push (p->ibuf, buf, len);
   for (;;)
     {
-      if (SHOULD_EMIT_DELAY (&p))
-        emit_delay (&p);
-      handle_pending_signal (&p);
-      c = inputbuf_get (p.ibuf);
-      if (c == EOF)
+      const unsigned char *text;
+      size_t n;
+
+      before_char (p);
+      if (SCREEN_RUNS (p) && (n = text_run (p, &text)) != 0)
         {
-          if (signal_pending_p)
-            continue;
-          else
-            break;
+          screen_write (p->screen, text, n);
+          inputbuf_skip (p->ibuf, n);
+          continue;
         }
-      else
+      if (SCREEN_RUNS (p) && (n = csi_run (p)) != 0)
+        {
+          inputbuf_skip (p->ibuf, n);
+          continue;
+        }
+      c = inputbuf_get (p->ibuf);
+      if (c == EOF && p->in_header && inputbuf_ended (p->ibuf))
+        {
+          end_header (p);
+          continue;
+        }
+      if (c == EOF)
+        break;
+      if (c == C_ESC && !inputbuf_ended (p->ibuf) && !escape_complete (p))
         {
-          process (&p, c);
+          /* Keep the rest for the next push; or, if there's no room
+             to, decode it now, as though the input ended here, so
+             that nothing is left pointing into the caller's buffer. */
+          if (inputbuf_unget (p->ibuf, c) == 0)
+            {
+              if (inputbuf_hold (p->ibuf) == 0)
+                break;
+              c = inputbuf_get (p->ibuf);
+            }
         }
+      process_input (p, c);
+    }
+}
+
+/* Read P's delays from TIMINGS, as for -t, or none if it's NULL.
+   Must be called before anything is fed to P. */
+void
+processor_set_timings (struct processor *p, FILE *timings)
+{
+  p->timings = timings;
+  p->in_header = timings != NULL;
+}
+
+/* Start over with a new input, as when a file being followed is
+   replaced: decode what's left of the old one as at its end, and
+   finish off its last line, before anything more is fed. */
+void
+processor_restart (struct processor *p)
+{
+  processor_feed (p, NULL, 0);
+  finish_state (p);
+  p->print_dot = 0;
+}
+
+/* Finish off the output, at the end of the input. */
+void
+processor_finish (struct processor *p)
+{
+  finish_state (p);
+  if (p->cfg->screen == CFG_SCREEN_DUMP && screen_is_dirty (p->screen))
+    dump_screen (p);
+  else if (p->screen)
+    screen_finish_history (p->screen);
+  if (p->stats
+      && stats_print (p->stats, p->outf,
+                      p->cfg->stats == CFG_STATS_JSON) != 0)
+    p->handler (errno, p->handler_arg);
+}
+
+#ifdef TESEQ_BENCH
+/* Release everything configure set up, so that the benchmark can run
+   us over and over. */
+static void
+release (struct config *cfg, struct processor *p)
+{
+  if (p->inf != stdin)
+    fclose (p->inf);
+  if (cfg->timings)
+    fclose (cfg->timings);
+  processor_release (p);
+  free (cfg->colors.text.seq);
+  free (cfg->colors.text_decor.seq);
+  free (cfg->colors.ctrl.seq);
+  free (cfg->colors.esc.seq);
+  free (cfg->colors.label.seq);
+  free (cfg->colors.desc.seq);
+  free (cfg->colors.delay.seq);
+  free (cfg->only.csi);
+  free (cfg->only.esc);
+}
+
+/* bench.c has its own main, and calls this one for each run. */
+#  define main teseq_main
+#endif
+
+int
+main (int argc, char **argv)
+{
+  int c;
+  int err;
+  int status = EXIT_SUCCESS;
+  struct config cfg = { 0 };
+  struct processor p = { 0 };
+
+  configure (&cfg, &p, argc, argv);
+  if (cfg.listen)
+    return server_run (&cfg);
+  if (cfg.batch_dir)
+    return batch_run (&cfg);
+  if (cfg.command)
+    status = child_run (&p, &cfg, STDOUT_FILENO);
+  else if (cfg.follow)
+    {
+      if (follow_run (&p, cfg.follow, fileno (p.inf), p.outf) != 0)
+        status = EXIT_FAILURE;
+    }
+  else if (cfg.passthrough || cfg.timestamp || cfg.checkpoint)
+    {
+      if (passthrough_run (&p, &cfg, fileno (p.inf),
+                           cfg.passthrough ? STDOUT_FILENO : -1) != 0)
+        status = EXIT_FAILURE;
+    }
+  else if (cfg.decompress || cfg.pipeline)
+    {
+      if (decompress_run (&p, &cfg, fileno (p.inf)) != 0)
+        status = EXIT_FAILURE;
+    }
+  else if (cfg.direct)
+    {
+      if (passthrough_run (&p, &cfg, fileno (p.inf), -1) != 0)
+        status = EXIT_FAILURE;
+    }
+  else
+    for (;;)
+      {
+        before_char (&p);
+        if (signal_pending_p)
+          handle_pending_signal (&p);
+#ifdef ENABLE_INSTRUMENTATION
+        if (instr_dump_pending)
+          {
+            instr_dump_pending = 0;
+            instr_dump (stderr);
+          }
+#endif
+        c = inputbuf_get (p.ibuf);
+        if (c == EOF)
+          {
+            if (p.in_header)
+              end_header (&p);
+            else if (!signal_pending_p)
+              break;
+          }
+        else
+          {
+            process_input (&p, c);
+          }
+      }
+  if (!cfg.checkpoint)
+    processor_finish (&p);
+  if (cfg.snapshots)
+    {
+      take_snapshot (&p);
+      if (fclose (cfg.snapshots) != 0)
+        handle_write_error (errno, (void *)program_name);
+    }
+  if (cfg.record && fclose (cfg.record) != 0)
+    handle_write_error (errno, (void *)program_name);
+  if (cfg.record_timings && fclose (cfg.record_timings) != 0)
+    handle_write_error (errno, (void *)program_name);
+  if (cfg.index)
+    {
+      if (index_write (p.index, cfg.index) != 0
+          || fclose (cfg.index) != 0)
+        handle_write_error (errno, (void *)program_name);
     }
-  finish_state (&p);
   if ((err = inputbuf_io_error (p.ibuf)) != 0)
     fprintf (stderr, "%s: %s: %s\n", program_name, "read error", strerror (err));
-  return EXIT_SUCCESS;
+#ifdef ENABLE_INSTRUMENTATION
+  /* Count the last of the output's writes. */
+  if (fflush (p.outf) != 0)
+    handle_write_error (errno, (void *)program_name);
+  instr_dump (stderr);
+#endif
+  /* This finishes compressed output, too. */
+  if (p.outf != stdout && fclose (p.outf) != 0)
+    handle_write_error (errno, (void *)program_name);
+  /* The checkpoint is only written once the output is out. */
+  if (cfg.checkpoint)
+    {
+      if (fflush (stdout) != 0)
+        handle_write_error (errno, (void *)program_name);
+      if (processor_checkpoint (&p) != 0)
+        status = EXIT_FAILURE;
+    }
+#ifdef TESEQ_BENCH
+  release (&cfg, &p);
+#endif
+  return status;
 }
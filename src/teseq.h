@@ -25,16 +25,75 @@
 #define _XOPEN_SOURCE 600
 
 #include <stdio.h>
+#include <sys/types.h>
 
 #define N_ARY_ELEMS(ary)        (sizeof (ary) / sizeof (ary)[0])
 
 enum {
     CFG_COLOR_NONE,
     CFG_COLOR_AUTO,
-    CFG_COLOR_ALWAYS,
-    CFG_COLOR_SET       /* Used temporarily when processing options. */
+    CFG_COLOR_ALWAYS
 };
 
+enum {
+    CFG_SCREEN_NONE,
+    CFG_SCREEN_DUMP,    /* --screen */
+    CFG_SCREEN_TEXT     /* --text */
+};
+
+enum {
+    CFG_STATS_NONE,
+    CFG_STATS_TABLE,
+    CFG_STATS_JSON
+};
+
+/* Special widths for output lines; any other is a number of columns. */
+#define CFG_WIDTH_UNLIMITED     0
+#define CFG_WIDTH_AUTO          ((size_t) -1)
+
+enum {
+    CFG_COMPRESS_NONE,
+    CFG_COMPRESS_GZIP,
+    CFG_COMPRESS_ZSTD
+};
+
+struct sgr_def {
+    const char *sgr;
+    unsigned int len;
+    char *seq;          /* The escape sequences, from putter_cache_sgr. */
+    unsigned int seqlen;
+};
+
+/* The colors of each kind of output line. */
+struct colors
+{
+  struct sgr_def text;          /* Text within a text line. */
+  struct sgr_def text_decor;    /* The |'s around it. */
+  struct sgr_def ctrl;
+  struct sgr_def esc;
+  struct sgr_def label;
+  struct sgr_def desc;
+  struct sgr_def delay;
+};
+
+/* The events selected by --only. */
+struct only_filter
+{
+  int active;
+  int text;
+  int delays;
+  int all_controls;
+  int all_csi;
+  int all_esc;
+  char controls[0x21];          /* By C0 code, with DEL last. */
+  const char **csi;             /* Selected acronyms. */
+  size_t n_csi;
+  const char **esc;
+  size_t n_esc;
+};
+
+/* A decoder's configuration. Once set up, it is only read, and can be
+   shared by any number of decoders. */
 struct config
 {
   int control_hats;
@@ -45,15 +104,60 @@ struct config
   int handle_signals;
   FILE *timings;
   int color;
+  int screen;
+  size_t screen_cols;
+  size_t screen_rows;
+  FILE *snapshots;
+  off_t snapshot_bytes;         /* Snapshot interval, in bytes of input */
+  double snapshot_secs;         /* ...or in seconds of delay. */
+  FILE *index;
+  int stats;
+  const char *listen;           /* Socket to serve, for --listen. */
+  long threads;
+  const char *passthrough;      /* Output file, for --passthrough. */
+  char **command;               /* Command to run, for --command... */
+  FILE *record;                 /* ...with a typescript of its output, */
+  FILE *record_timings;         /* and the timings for it. */
+  int timestamp;                /* Time the input as it's read. */
+  int decompress;               /* The input's compression, if any. */
+  int output_compress;          /* Compression for the output... */
+  int output_compress_level;    /* ...and its level, or -1. */
+  int pipeline;                 /* Read and write on threads of their own. */
+  int direct;                   /* The input is fed to the processor from
+                                   its descriptor, not read through it. */
+  size_t max_lookahead;         /* The longest escape sequence decoded. */
+  const char *checkpoint;       /* Where to resume from, and save to. */
+  const char *follow;           /* The file to follow, for -f. */
+  const char *batch_dir;        /* Output directory, for --batch... */
+  char **batch_files;           /* ...and the files to decode, or NULL
+                                   to read their names. */
+  size_t width;                 /* Where output lines are split. */
+  int output_tty;               /* The output is a terminal. */
+  struct colors colors;
+  struct only_filter only;
 };
-extern struct config configuration;
 
-struct sgr_def {
-    const char *sgr;
-    unsigned int len;
-};
+extern const char *control_names[];
+extern const char *c1_labels[][2];
+const char *fp_fs_label (unsigned char, const char **);
+
+/* A decoder, for when the input is handed over a piece at a time
+   (see server.c). */
+struct processor;
+
+struct processor *processor_new (const struct config *, FILE *);
+struct processor *processor_reuse (struct processor *, FILE *);
+void processor_delete (struct processor *);
+void processor_set_handler (struct processor *, void (*)(int, void *),
+                            void *);
+void processor_feed (struct processor *, const unsigned char *, size_t);
+void processor_delay (struct processor *, double);
+void processor_restart (struct processor *);
+void processor_set_timings (struct processor *, FILE *);
+void processor_finish (struct processor *);
 
-extern struct sgr_def        sgr_text, sgr_text_decor, sgr_ctrl, sgr_esc,
-                             sgr_label, sgr_desc, sgr_delay;
+#ifdef TESEQ_BENCH
+int teseq_main (int, char **);
+#endif
 
 #endif /* TESEQ_H_ */
@@ -0,0 +1,180 @@
+/* tty.c: terminal and signal handling, for interactive use. */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "teseq.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+#include "tty.h"
+
+volatile sig_atomic_t signal_pending_p;
+
+static struct termios saved_stty;
+static struct termios working_stty;
+static int input_term_fd = -1;
+static int pending_signal;
+
+static void
+catchsig (int s)
+{
+  if (!signal_pending_p)
+    {
+      pending_signal = s;
+      signal_pending_p = 1;
+    }
+}
+
+/* Put the terminal on FD into non-canonical mode (and, if the output
+   is a terminal too, turn off echoing), and tell the user so. */
+void
+tty_setup (int fd, int output_tty)
+{
+  struct termios ti;
+  int            intr;
+
+  if (tcgetattr (fd, &ti) != 0)
+    return;
+  saved_stty = ti;
+  intr = ti.c_cc[VINTR];
+  ti.c_lflag &= ~ICANON;
+  if (output_tty)
+    ti.c_lflag &= ~ECHO;
+  working_stty = ti;
+  input_term_fd = fd;
+  tcsetattr (fd, TCSANOW, &ti);
+
+  /* Notify the user that they're in non-canonical mode. */
+
+  fprintf (stderr,
+           "  Terminal detected. Interactive mode (-I option to disable).\n"
+           "  Send the interrupt character to exit.");
+
+  if (intr < 0x20)
+    {
+      fprintf (stderr, " (Control-%c)",
+               intr + '@');  /* <--- Example: '\003' -> (Control-C) */
+    }
+  else if (intr == 0x7f)
+    {
+      fprintf (stderr, " (DEL, or Control-?)");
+    }
+
+  fputs ("\n\n", stderr);
+}
+
+/* Put the terminal on FD into raw mode, for passing what's typed on to
+   a command (see child.c). Output processing is turned off too if
+   RAW_OUTPUT is set, for when the command's own output is copied to
+   the terminal. */
+void
+tty_raw (int fd, int raw_output)
+{
+  struct termios ti;
+
+  if (tcgetattr (fd, &ti) != 0)
+    return;
+  saved_stty = ti;
+  ti.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR
+                  | ICRNL | IXON);
+  ti.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+  if (raw_output)
+    ti.c_oflag &= ~OPOST;
+  ti.c_cc[VMIN] = 1;
+  ti.c_cc[VTIME] = 0;
+  working_stty = ti;
+  input_term_fd = fd;
+  tcsetattr (fd, TCSAFLUSH, &ti);
+}
+
+/* Put the terminal back the way it was found. */
+void
+tty_restore (void)
+{
+  if (input_term_fd != -1)
+    tcsetattr (input_term_fd, TCSAFLUSH, &saved_stty);
+}
+
+/* The width of the terminal on FD, or zero if it isn't one (or won't
+   say). */
+size_t
+tty_width (int fd)
+{
+#ifdef TIOCGWINSZ
+  struct winsize ws;
+
+  if (ioctl (fd, TIOCGWINSZ, &ws) == 0)
+    return ws.ws_col;
+#endif
+  return 0;
+}
+
+void
+signal_setup (void)
+{
+  static const int sigs[] =
+    {
+      SIGINT,
+      SIGTERM,
+      SIGTSTP,
+      SIGTTIN,
+      SIGTTOU
+    };
+  const int *sig, *sige = sigs + N_ARY_ELEMS (sigs);
+  struct sigaction sa;
+  sigset_t mask;
+
+  sigemptyset (&mask);
+  for (sig = sigs; sig != sige; ++sig)
+    sigaddset (&mask, *sig);
+  
+  sa.sa_handler = catchsig;
+  sa.sa_mask = mask;
+  sa.sa_flags = 0;
+  
+  for (sig = sigs; sig != sige; ++sig)
+    sigaction (*sig, &sa, NULL);
+}
+
+/* Let the signal that was caught take effect, with the terminal's
+   original settings, and then carry on. */
+void
+signal_raise_pending (void)
+{
+  struct sigaction sa;
+
+  if (input_term_fd != -1)
+    tcsetattr (input_term_fd, TCSANOW, &saved_stty);
+
+  sigaction (pending_signal, NULL, &sa);
+  sa.sa_handler = SIG_DFL;
+  sigaction (pending_signal, &sa, NULL);
+  raise (pending_signal);
+  sa.sa_handler = catchsig;
+  sigaction (pending_signal, &sa, NULL);
+
+  if (input_term_fd != -1)
+    tcsetattr (input_term_fd, TCSANOW, &working_stty);
+
+  signal_pending_p = 0;
+}
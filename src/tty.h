@@ -0,0 +1,57 @@
+/* tty.h */
+
+/*
+    Copyright (C) 2008,2013 Micah Cowan
+
+    This file is part of GNU teseq.
+
+    GNU teseq is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GNU teseq is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    The interactive front end.
+
+    When teseq reads from a terminal, it puts the terminal into
+    non-canonical mode, so that input is seen as it's typed. Signals
+    that would stop or end the program are caught, so that the output
+    line in progress can be finished first: the main loop checks
+    signal_pending_p, finishes what it's doing, and then calls
+    signal_raise_pending to have the signal take effect, with the
+    terminal's settings restored around it.
+
+    When teseq runs a command itself (--command), the terminal is put
+    into raw mode instead, so that everything typed, including the
+    interrupt character, goes to the command.
+
+    Signals and terminals belong to the whole program, so this state
+    is global, and is kept apart from the decoder (which has none).
+*/
+
+#ifndef TTY_H
+#define TTY_H
+
+#include "teseq.h"
+
+#include <signal.h>
+
+extern volatile sig_atomic_t signal_pending_p;
+
+void tty_setup (int fd, int output_tty);
+void tty_raw (int fd, int raw_output);
+void tty_restore (void);
+size_t tty_width (int fd);
+void signal_setup (void);
+void signal_raise_pending (void);
+
+#endif